@@ -1,150 +1,484 @@
 #include "annotations.h"
 #include "ioUtils.h"
-#include <set>
+#include "mappedFile.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
 #include <fstream>
 #include <iostream>
 
-int readAnnotations(const std::string file, std::vector<ImageAnnotation> &result)
+static bool isBlank(char c)
 {
-    std::ifstream f;
-    f.open(file);
-    if (!f.is_open())
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skipBlanks(const char *p, const char *end)
+{
+    while (p < end && isBlank(*p))
     {
-        std::cout << "Can't open annotations file " << file << std::endl;
-        return 1;
+        p++;
     }
+    return p;
+}
 
-    while (true)
+// Returns the position after the number or nullptr if there is no valid int
+static const char *parseInt(const char *p, const char *end, int &value)
+{
+    bool isNegative = false;
+    if (p < end && (*p == '-' || *p == '+'))
     {
-        std::string imageFileName;
-        int x1, y1, x2, y2;
-        f >> imageFileName;
-        f >> y1;
-        f >> x1;
-        f >> y2;
-        f >> x2;
+        isNegative = *p == '-';
+        p++;
+    }
 
-        if (f.eof())
+    const char *digits = p;
+    long long result = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (*p - '0');
+        p++;
+        if (result > INT_MAX)
         {
-            f.close();
-            return 0;
+            return nullptr;
         }
-
-        ImageAnnotation annotation;
-        annotation.FileName = imageFileName + ".jpg";
-        annotation.Bbox = cv::Rect(x1, y1, x2 - x1, y2 - y1);
-        result.push_back(annotation);
     }
+    if (p == digits)
+    {
+        return nullptr;
+    }
+
+    value = static_cast<int>(isNegative ? -result : result);
+    return p;
 }
 
-int writeAnnotations(const std::string file, const std::vector<ImageAnnotation> &data)
+// Returns the position after the number or nullptr if there is no valid float
+static const char *parseFloat(const char *p, const char *end, float &value)
 {
-    std::ofstream f;
-    f.open(file);
-    if (!f.is_open())
+    const char *tokenEnd = p;
+    while (tokenEnd < end && !isBlank(*tokenEnd))
     {
-        std::cout << "Can't open file to save annotations " << file << std::endl;
-        return 1;
+        tokenEnd++;
     }
 
-    for (int i = 0; i < data.size(); i++)
+    // The mapping isn't null terminated, so the token is copied for strtof
+    char token[64];
+    size_t length = tokenEnd - p;
+    if (length == 0 || length >= sizeof(token))
     {
-        ImageAnnotation annotation = data[i];
-        std::string imageFileName = fileNameWithoutExtension(annotation.FileName);
-        cv::Rect bbox = annotation.Bbox;
-        f << imageFileName
-          << '\t' << bbox.y
-          << '\t' << bbox.x
-          << '\t' << bbox.y + bbox.height
-          << '\t' << bbox.x + bbox.width
-          << '\n';
+        return nullptr;
     }
+    std::memcpy(token, p, length);
+    token[length] = '\0';
 
-    f.close();
-
-    return 0;
+    char *parsedEnd;
+    value = std::strtof(token, &parsedEnd);
+    return parsedEnd == token + length ? tokenEnd : nullptr;
 }
 
-void evaluateDetectionAnnotations(
-    const std::vector<ImageAnnotation> &actual,
-    const std::vector<ImageAnnotation> &detected)
+// Parses "name y1 x1 y2 x2 [score]" of a single line, the end points at its line break
+static bool parseAnnotationLine(const char *p, const char *end, std::string_view &name, int (&coordinates)[4], bool &hasScore, float &score)
 {
-    std::set<std::string> allImages;
-    for (auto b = actual.begin(), e = actual.end(); b != e; b++)
+    p = skipBlanks(p, end);
+    const char *nameStart = p;
+    while (p < end && !isBlank(*p))
     {
-        allImages.insert(b->FileName);
+        p++;
     }
-    for (auto b = detected.begin(), e = detected.end(); b != e; b++)
+    name = std::string_view(nameStart, p - nameStart);
+
+    for (int i = 0; i < 4; i++)
     {
-        allImages.insert(b->FileName);
+        const char *valueStart = skipBlanks(p, end);
+        if (valueStart == p)
+        {
+            return false;
+        }
+        p = parseInt(valueStart, end, coordinates[i]);
+        if (p == nullptr)
+        {
+            return false;
+        }
     }
 
-    int truePositives = 0;  // Detected pedestrians who overlap at least 50% with the correct pedestrians
-    int falsePositives = 0; // Detected pedestrians who overlap less than 50% with the correct pedestrians
-    int actualPeopleCount = actual.size();
+    const char *scoreStart = skipBlanks(p, end);
+    hasScore = scoreStart != end;
+    if (hasScore)
+    {
+        if (scoreStart == p)
+        {
+            return false;
+        }
+        p = parseFloat(scoreStart, end, score);
+        if (p == nullptr)
+        {
+            return false;
+        }
+    }
 
-    for (auto b = allImages.begin(), e = allImages.end(); b != e; b++)
+    return skipBlanks(p, end) == end;
+}
+
+static int readTextAnnotationColumns(const std::string file, const char *p, const char *end, AnnotationColumns &result)
+{
+    size_t expectedLines = std::count(p, end, '\n') + 1;
+    result.FileIds.reserve(expectedLines);
+    result.Y1.reserve(expectedLines);
+    result.X1.reserve(expectedLines);
+    result.Y2.reserve(expectedLines);
+    result.X2.reserve(expectedLines);
+    result.Scores.reserve(expectedLines);
+
+    // Views point into the mapping, so names are only copied once per file
+    std::unordered_map<std::string_view, int> fileIds;
+
+    const int maxReportedLines = 10;
+    int malformedLines = 0;
+    int scoredLines = 0;
+    int lineNumber = 0;
+    while (p < end)
     {
-        std::string currentImage = *b;
-        std::vector<cv::Rect> actualPeople;
-        std::vector<cv::Rect> detectedPeople;
+        lineNumber++;
+        const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        if (lineEnd == nullptr)
+        {
+            lineEnd = end;
+        }
 
-        for (int i = 0; i < actual.size(); i++)
+        std::string_view name;
+        int coordinates[4];
+        bool hasScore = false;
+        float score = 0;
+        if (skipBlanks(p, lineEnd) == lineEnd)
+        {
+            // Empty line
+        }
+        else if (!parseAnnotationLine(p, lineEnd, name, coordinates, hasScore, score))
         {
-            if (actual[i].FileName == currentImage)
+            if (malformedLines < maxReportedLines)
             {
-                actualPeople.push_back(actual[i].Bbox);
+                std::cout << "Malformed annotation at " << file << ":" << lineNumber << std::endl;
             }
+            malformedLines++;
         }
-        for (int i = 0; i < detected.size(); i++)
+        else
         {
-            if (detected[i].FileName == currentImage)
+            auto found = fileIds.find(name);
+            int fileId;
+            if (found == fileIds.end())
             {
-                detectedPeople.push_back(detected[i].Bbox);
+                fileId = result.FileNames.size();
+                result.FileNames.push_back(std::string(name) + ".jpg");
+                fileIds[name] = fileId;
             }
+            else
+            {
+                fileId = found->second;
+            }
+
+            result.FileIds.push_back(fileId);
+            result.Y1.push_back(coordinates[0]);
+            result.X1.push_back(coordinates[1]);
+            result.Y2.push_back(coordinates[2]);
+            result.X2.push_back(coordinates[3]);
+            result.Scores.push_back(score);
+            scoredLines += hasScore ? 1 : 0;
+        }
+
+        p = lineEnd + 1;
+    }
+
+    if (scoredLines == 0)
+    {
+        result.Scores.clear();
+    }
+    else if (scoredLines != result.FileIds.size())
+    {
+        std::cout << "Only " << scoredLines << " of " << result.FileIds.size() << " annotations have scores in " << file << std::endl;
+        return 1;
+    }
+
+    if (malformedLines > 0)
+    {
+        std::cout << malformedLines << " malformed lines in annotations file " << file << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Binary layout: header, name offsets, name bytes, padding to 4 bytes,
+// then the int32 FileIds, Y1, X1, Y2, X2 columns and optional float Scores
+static const char BINARY_ANNOTATIONS_MAGIC[8] = {'P', 'P', 'L', 'A', 'N', 'N', 'O', 'T'};
+static const uint32_t BINARY_ANNOTATIONS_VERSION = 1;
+static const uint32_t BINARY_ANNOTATIONS_HAS_SCORES = 1;
+
+struct BinaryAnnotationsHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Flags;
+    uint64_t FileNamesCount;
+    uint64_t FileNamesBytes;
+    uint64_t RecordsCount;
+};
+
+static size_t alignTo4(size_t offset)
+{
+    return (offset + 3) / 4 * 4;
+}
+
+static int readBinaryAnnotationColumns(const std::string file, const char *data, size_t size, AnnotationColumns &result)
+{
+    BinaryAnnotationsHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.Version != BINARY_ANNOTATIONS_VERSION)
+    {
+        std::cout << "Unsupported annotations version " << header.Version << " in " << file << std::endl;
+        return 1;
+    }
+
+    // Counts bounded by the file size keep the offsets below from wrapping around
+    if (header.FileNamesCount > size / sizeof(uint32_t) || header.FileNamesBytes > size || header.RecordsCount > size / sizeof(int32_t))
+    {
+        std::cout << "Truncated or corrupted annotations file " << file << std::endl;
+        return 1;
+    }
+
+    bool hasScores = (header.Flags & BINARY_ANNOTATIONS_HAS_SCORES) != 0;
+    size_t namesOffset = sizeof(header) + (header.FileNamesCount + 1) * sizeof(uint32_t);
+    size_t columnsOffset = alignTo4(namesOffset + header.FileNamesBytes);
+    size_t columnBytes = header.RecordsCount * sizeof(int32_t);
+    size_t expectedSize = columnsOffset + columnBytes * (hasScores ? 6 : 5);
+    if (header.FileNamesCount > INT_MAX || header.RecordsCount > INT_MAX || size != expectedSize)
+    {
+        std::cout << "Truncated or corrupted annotations file " << file << std::endl;
+        return 1;
+    }
+
+    const uint32_t *nameOffsets = reinterpret_cast<const uint32_t *>(data + sizeof(header));
+    const char *names = data + namesOffset;
+    result.FileNames.resize(header.FileNamesCount);
+    for (size_t i = 0; i < header.FileNamesCount; i++)
+    {
+        if (nameOffsets[i] > nameOffsets[i + 1] || nameOffsets[i + 1] > header.FileNamesBytes)
+        {
+            std::cout << "Corrupted file names table in " << file << std::endl;
+            return 1;
         }
+        result.FileNames[i].assign(names + nameOffsets[i], nameOffsets[i + 1] - nameOffsets[i]);
+    }
+
+    size_t n = header.RecordsCount;
+    const int32_t *columns = reinterpret_cast<const int32_t *>(data + columnsOffset);
+    result.FileIds.assign(columns, columns + n);
+    result.Y1.assign(columns + n, columns + 2 * n);
+    result.X1.assign(columns + 2 * n, columns + 3 * n);
+    result.Y2.assign(columns + 3 * n, columns + 4 * n);
+    result.X2.assign(columns + 4 * n, columns + 5 * n);
+    if (hasScores)
+    {
+        const float *scores = reinterpret_cast<const float *>(columns + 5 * n);
+        result.Scores.assign(scores, scores + n);
+    }
 
-        if (actualPeople.size() == 0)
+    for (size_t i = 0; i < n; i++)
+    {
+        if (static_cast<uint32_t>(result.FileIds[i]) >= header.FileNamesCount)
         {
-            falsePositives += detectedPeople.size();
-            continue;
+            std::cout << "Invalid file id in record " << i << " of " << file << std::endl;
+            return 1;
         }
+    }
+
+    return 0;
+}
+
+int readAnnotationColumns(const std::string file, AnnotationColumns &result)
+{
+    result = AnnotationColumns();
+
+    MappedFile f;
+    if (!f.open(file))
+    {
+        std::cout << "Can't open annotations file " << file << std::endl;
+        return 1;
+    }
+
+    const char *data = f.data();
+    bool isBinary = f.size() >= sizeof(BinaryAnnotationsHeader) &&
+                    std::memcmp(data, BINARY_ANNOTATIONS_MAGIC, sizeof(BINARY_ANNOTATIONS_MAGIC)) == 0;
+    if (isBinary)
+    {
+        return readBinaryAnnotationColumns(file, data, f.size(), result);
+    }
+    return readTextAnnotationColumns(file, data, data + f.size(), result);
+}
+
+bool isBinaryAnnotationsFile(const std::string file)
+{
+    const std::string extension = ".bin";
+    return file.size() >= extension.size() &&
+           file.compare(file.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+int writeAnnotationColumns(const std::string file, const AnnotationColumns &columns)
+{
+    std::ofstream f;
+    f.open(file, std::ios::binary);
+    if (!f.is_open())
+    {
+        std::cout << "Can't open file to save annotations " << file << std::endl;
+        return 1;
+    }
 
-        if (detectedPeople.size() == 0)
+    bool hasScores = !columns.Scores.empty();
+    std::vector<uint32_t> nameOffsets(1, 0);
+    for (int i = 0; i < columns.FileNames.size(); i++)
+    {
+        nameOffsets.push_back(nameOffsets.back() + columns.FileNames[i].size());
+    }
+
+    BinaryAnnotationsHeader header;
+    std::memcpy(header.Magic, BINARY_ANNOTATIONS_MAGIC, sizeof(header.Magic));
+    header.Version = BINARY_ANNOTATIONS_VERSION;
+    header.Flags = hasScores ? BINARY_ANNOTATIONS_HAS_SCORES : 0;
+    header.FileNamesCount = columns.FileNames.size();
+    header.FileNamesBytes = nameOffsets.back();
+    header.RecordsCount = columns.FileIds.size();
+
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char *>(nameOffsets.data()), nameOffsets.size() * sizeof(uint32_t));
+    for (int i = 0; i < columns.FileNames.size(); i++)
+    {
+        f.write(columns.FileNames[i].data(), columns.FileNames[i].size());
+    }
+
+    size_t namesEnd = sizeof(header) + nameOffsets.size() * sizeof(uint32_t) + header.FileNamesBytes;
+    const char padding[4] = {0, 0, 0, 0};
+    f.write(padding, alignTo4(namesEnd) - namesEnd);
+
+    size_t columnBytes = header.RecordsCount * sizeof(int32_t);
+    f.write(reinterpret_cast<const char *>(columns.FileIds.data()), columnBytes);
+    f.write(reinterpret_cast<const char *>(columns.Y1.data()), columnBytes);
+    f.write(reinterpret_cast<const char *>(columns.X1.data()), columnBytes);
+    f.write(reinterpret_cast<const char *>(columns.Y2.data()), columnBytes);
+    f.write(reinterpret_cast<const char *>(columns.X2.data()), columnBytes);
+    if (hasScores)
+    {
+        f.write(reinterpret_cast<const char *>(columns.Scores.data()), header.RecordsCount * sizeof(float));
+    }
+
+    f.close();
+    if (f.fail())
+    {
+        std::cout << "Can't write annotations file " << file << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+void annotationsToColumns(const std::vector<ImageAnnotation> &annotations, bool withScores, AnnotationColumns &result)
+{
+    result = AnnotationColumns();
+
+    std::unordered_map<std::string, int> fileIds;
+    for (int i = 0; i < annotations.size(); i++)
+    {
+        const ImageAnnotation &annotation = annotations[i];
+        auto found = fileIds.find(annotation.FileName);
+        int fileId;
+        if (found == fileIds.end())
         {
-            continue;
+            fileId = result.FileNames.size();
+            result.FileNames.push_back(annotation.FileName);
+            fileIds[annotation.FileName] = fileId;
+        }
+        else
+        {
+            fileId = found->second;
         }
 
-        for (int di = 0; di < detectedPeople.size(); di++)
+        result.FileIds.push_back(fileId);
+        result.Y1.push_back(annotation.Bbox.y);
+        result.X1.push_back(annotation.Bbox.x);
+        result.Y2.push_back(annotation.Bbox.y + annotation.Bbox.height);
+        result.X2.push_back(annotation.Bbox.x + annotation.Bbox.width);
+        if (withScores)
         {
-            bool isCorrect = false;
-            cv::Rect detectedBox = detectedPeople[di];
-            for (int ai = 0; ai < actualPeople.size(); ai++)
-            {
-                cv::Rect actualBox = actualPeople[ai];
-                int actualAreaSize = actualBox.area();
-                int overlapAreaSize = (actualBox & detectedBox).area();
-                if (overlapAreaSize >= actualAreaSize / 2)
-                {
-                    isCorrect = true;
-                    break;
-                }
-            }
+            result.Scores.push_back(annotation.Score);
+        }
+    }
+}
 
-            if (isCorrect)
-            {
-                truePositives++;
-            }
-            else
-            {
-                falsePositives++;
-            }
+void columnsToAnnotations(const AnnotationColumns &columns, std::vector<ImageAnnotation> &result)
+{
+    result.reserve(result.size() + columns.FileIds.size());
+    for (int i = 0; i < columns.FileIds.size(); i++)
+    {
+        ImageAnnotation annotation;
+        annotation.FileName = columns.FileNames[columns.FileIds[i]];
+        annotation.Bbox = cv::Rect(columns.X1[i], columns.Y1[i], columns.X2[i] - columns.X1[i], columns.Y2[i] - columns.Y1[i]);
+        annotation.Score = columns.Scores.empty() ? 0 : columns.Scores[i];
+        result.push_back(annotation);
+    }
+}
+
+int readAnnotations(const std::string file, std::vector<ImageAnnotation> &result)
+{
+    AnnotationColumns columns;
+    if (readAnnotationColumns(file, columns) != 0)
+    {
+        return 1;
+    }
+
+    columnsToAnnotations(columns, result);
+    return 0;
+}
+
+int writeAnnotations(const std::string file, const std::vector<ImageAnnotation> &data, bool withScores)
+{
+    if (isBinaryAnnotationsFile(file))
+    {
+        AnnotationColumns columns;
+        annotationsToColumns(data, withScores, columns);
+        return writeAnnotationColumns(file, columns);
+    }
+
+    std::ofstream f;
+    f.open(file);
+    if (!f.is_open())
+    {
+        std::cout << "Can't open file to save annotations " << file << std::endl;
+        return 1;
+    }
+    // Scores parse back to the same floats, so thresholds found by eval hold for test
+    f << std::setprecision(std::numeric_limits<float>::max_digits10);
+
+    for (int i = 0; i < data.size(); i++)
+    {
+        ImageAnnotation annotation = data[i];
+        std::string imageFileName = fileNameWithoutExtension(annotation.FileName);
+        cv::Rect bbox = annotation.Bbox;
+        f << imageFileName
+          << '\t' << bbox.y
+          << '\t' << bbox.x
+          << '\t' << bbox.y + bbox.height
+          << '\t' << bbox.x + bbox.width;
+        if (withScores)
+        {
+            f << '\t' << annotation.Score;
         }
+        f << '\n';
     }
 
-    double recall = static_cast<double>(truePositives) / actualPeopleCount;
-    double precision = static_cast<double>(truePositives) / (truePositives + falsePositives);
+    f.close();
 
-    std::cout << "Recall   : " << recall << std::endl;
-    std::cout << "Precision: " << precision << std::endl;
-}
\ No newline at end of file
+    return 0;
+}
@@ -1,14 +1,37 @@
+#pragma once
 #include <string>
+#include <vector>
 #include <opencv2/core/types.hpp>
 
 struct ImageAnnotation
 {
     std::string FileName;
     cv::Rect Bbox;
+    float Score = 0; // Decision score of a detection
 };
 
+// Annotations stored column by column, file names are interned in FileNames
+struct AnnotationColumns
+{
+    std::vector<std::string> FileNames;
+    std::vector<int> FileIds;
+    std::vector<int> Y1;
+    std::vector<int> X1;
+    std::vector<int> Y2;
+    std::vector<int> X2;
+    std::vector<float> Scores; // Empty when the file has no scores
+};
+
+// Reads text or binary annotations through a memory mapping.
+// Malformed text lines are reported with their line numbers.
+int readAnnotationColumns(const std::string file, AnnotationColumns &result);
+// Binary columnar format, chosen for files with the .bin extension
+int writeAnnotationColumns(const std::string file, const AnnotationColumns &columns);
+bool isBinaryAnnotationsFile(const std::string file);
+
+void columnsToAnnotations(const AnnotationColumns &columns, std::vector<ImageAnnotation> &result);
+void annotationsToColumns(const std::vector<ImageAnnotation> &annotations, bool withScores, AnnotationColumns &result);
+
 int readAnnotations(const std::string file, std::vector<ImageAnnotation> &result);
-int writeAnnotations(const std::string file, const std::vector<ImageAnnotation> &data);
-void evaluateDetectionAnnotations(
-    const std::vector<ImageAnnotation> &actual,
-    const std::vector<ImageAnnotation> &detected);
\ No newline at end of file
+// Text annotations get a sixth column with scores when withScores is set
+int writeAnnotations(const std::string file, const std::vector<ImageAnnotation> &data, bool withScores);
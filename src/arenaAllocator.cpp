@@ -0,0 +1,266 @@
+#include "arenaAllocator.h"
+#include "memoryStats.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Requests above half a chunk go to the heap, so a chunk is never mostly wasted
+static const size_t ARENA_CHUNK_SIZE = 8 << 20;
+static const size_t ARENA_ALIGNMENT = 64;
+// Set in the live count of a chunk dropped by its arena, the last Mat released frees it
+static const uint64_t CHUNK_RETIRED = 1ull << 63;
+
+struct ArenaChunk
+{
+    unsigned char *Data;
+    size_t Used;
+    std::atomic<uint64_t> LiveCount; // Mats placed in the chunk and not released yet
+    bool IsCounted;                  // Recorded by memory accounting
+};
+
+static void freeChunk(ArenaChunk *chunk)
+{
+    cv::fastFree(chunk->Data);
+    if (chunk->IsCounted)
+    {
+        recordFree(ARENA_CHUNK_SIZE);
+    }
+    delete chunk;
+}
+
+// Drops a chunk from its arena, it is freed now or by the last Mat placed in it
+static void retireChunk(ArenaChunk *chunk)
+{
+    uint64_t previous = chunk->LiveCount.fetch_or(CHUNK_RETIRED);
+    if (previous == 0)
+    {
+        freeChunk(chunk);
+    }
+}
+
+struct ThreadArena
+{
+    std::vector<ArenaChunk *> Chunks;
+    size_t Current = 0;
+    int Depth = 0;
+
+    ~ThreadArena()
+    {
+        for (ArenaChunk *chunk : Chunks)
+        {
+            retireChunk(chunk);
+        }
+    }
+};
+
+static thread_local ThreadArena threadArena;
+
+static std::atomic<bool> arenaEnabled(false);
+static std::atomic<int64_t> arenaAllocations(0);
+static std::atomic<int64_t> heapAllocations(0);
+static std::atomic<int64_t> chunkAllocations(0);
+static std::atomic<int64_t> chunksRetired(0);
+static std::atomic<int64_t> resets(0);
+static std::atomic<size_t> peakScopeBytes(0);
+
+static size_t alignSize(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+class ArenaAllocator : public cv::MatAllocator
+{
+public:
+    explicit ArenaAllocator(cv::MatAllocator *fallback)
+        : fallback(fallback)
+    {
+    }
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data0, size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        if (data0 != nullptr || threadArena.Depth == 0)
+        {
+            heapAllocations += data0 == nullptr ? 1 : 0;
+            return fallback->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        }
+
+        // Continuous layout, the same as the default allocator
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--)
+        {
+            if (step)
+            {
+                step[i] = total;
+            }
+            total *= sizes[i];
+        }
+
+        size_t headerSize = alignSize(sizeof(cv::UMatData));
+        size_t blockSize = headerSize + alignSize(std::max<size_t>(total, 1));
+        if (blockSize > ARENA_CHUNK_SIZE / 2)
+        {
+            heapAllocations++;
+            return fallback->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        }
+
+        ArenaChunk *chunk = findChunk(blockSize);
+        unsigned char *block = chunk->Data + chunk->Used;
+        chunk->Used += blockSize;
+        chunk->LiveCount++;
+        arenaAllocations++;
+
+        cv::UMatData *u = new (block) cv::UMatData(this);
+        u->data = u->origdata = block + headerSize;
+        u->size = total;
+        u->userdata = chunk;
+        return u;
+    }
+
+    bool allocate(cv::UMatData *u, cv::AccessFlag, cv::UMatUsageFlags) const override
+    {
+        return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData *u) const override
+    {
+        if (u == nullptr)
+        {
+            return;
+        }
+
+        ArenaChunk *chunk = static_cast<ArenaChunk *>(u->userdata);
+        u->~UMatData();
+        uint64_t previous = chunk->LiveCount.fetch_sub(1);
+        if (previous == (CHUNK_RETIRED | 1))
+        {
+            freeChunk(chunk);
+        }
+    }
+
+private:
+    cv::MatAllocator *fallback;
+
+    static ArenaChunk *findChunk(size_t blockSize)
+    {
+        ThreadArena &arena = threadArena;
+        while (arena.Current < arena.Chunks.size())
+        {
+            ArenaChunk *chunk = arena.Chunks[arena.Current];
+            if (chunk->Used + blockSize <= ARENA_CHUNK_SIZE)
+            {
+                return chunk;
+            }
+            arena.Current++;
+        }
+
+        ArenaChunk *chunk = new ArenaChunk();
+        chunk->Data = static_cast<unsigned char *>(cv::fastMalloc(ARENA_CHUNK_SIZE));
+        chunk->IsCounted = isMemoryAccountingEnabled();
+        if (chunk->IsCounted)
+        {
+            recordAllocation(ARENA_CHUNK_SIZE);
+        }
+        chunk->Used = 0;
+        chunk->LiveCount = 0;
+        arena.Chunks.push_back(chunk);
+        chunkAllocations++;
+        return chunk;
+    }
+};
+
+void installArenaAllocator()
+{
+    // Lives until the process exits, Mats may be released from static destructors
+    static std::once_flag installed;
+    std::call_once(installed, []()
+    {
+        static ArenaAllocator allocator(cv::Mat::getDefaultAllocator());
+        cv::Mat::setDefaultAllocator(&allocator);
+    });
+}
+
+void setArenaEnabled(bool enabled)
+{
+    if (enabled)
+    {
+        installArenaAllocator();
+    }
+    arenaEnabled = enabled;
+}
+
+bool isArenaEnabled()
+{
+    return arenaEnabled;
+}
+
+ArenaStats getArenaStats()
+{
+    ArenaStats stats;
+    stats.ArenaAllocations = arenaAllocations;
+    stats.HeapAllocations = heapAllocations;
+    stats.ChunkAllocations = chunkAllocations;
+    stats.ChunksRetired = chunksRetired;
+    stats.Resets = resets;
+    stats.PeakScopeBytes = peakScopeBytes;
+    return stats;
+}
+
+void printArenaStats()
+{
+    ArenaStats stats = getArenaStats();
+    std::cout << "Mat arena: " << stats.ArenaAllocations << " arena and " << stats.HeapAllocations
+              << " heap allocations, " << stats.ChunkAllocations << " chunks allocated, " << stats.ChunksRetired
+              << " retired, " << stats.Resets << " resets, peak " << stats.PeakScopeBytes / 1024 << " KB per scope" << std::endl;
+}
+
+ArenaScope::ArenaScope()
+    : isActive(arenaEnabled)
+{
+    if (isActive)
+    {
+        threadArena.Depth++;
+    }
+}
+
+ArenaScope::~ArenaScope()
+{
+    if (!isActive)
+    {
+        return;
+    }
+    ThreadArena &arena = threadArena;
+    arena.Depth--;
+    if (arena.Depth > 0)
+    {
+        return;
+    }
+
+    // Chunks without live Mats are rewound in place, the rest leave the arena
+    size_t scopeBytes = 0;
+    size_t kept = 0;
+    for (ArenaChunk *chunk : arena.Chunks)
+    {
+        scopeBytes += chunk->Used;
+        if (chunk->LiveCount.load() == 0)
+        {
+            chunk->Used = 0;
+            arena.Chunks[kept++] = chunk;
+        }
+        else
+        {
+            retireChunk(chunk);
+            chunksRetired++;
+        }
+    }
+    arena.Chunks.resize(kept);
+    arena.Current = 0;
+    resets++;
+
+    size_t peak = peakScopeBytes.load();
+    while (scopeBytes > peak && !peakScopeBytes.compare_exchange_weak(peak, scopeBytes))
+    {
+    }
+}
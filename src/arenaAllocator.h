@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core/core.hpp>
+
+// Counters of the arena allocator since it was installed
+struct ArenaStats
+{
+    int64_t ArenaAllocations; // Mats placed in an arena
+    int64_t HeapAllocations;  // Mats that went to the default allocator
+    int64_t ChunkAllocations; // Arena chunks taken from the heap
+    int64_t ChunksRetired;    // Chunks still holding Mats when their scope ended
+    int64_t Resets;           // Scopes that ended
+    size_t PeakScopeBytes;    // Most arena memory a single scope used
+};
+
+// Becomes the default cv::Mat allocator. Mats created on a thread inside an
+// ArenaScope come from a thread-local bump arena, others from the previous allocator.
+void installArenaAllocator();
+// Scopes only use arenas while enabled, the allocator itself stays installed
+void setArenaEnabled(bool enabled);
+bool isArenaEnabled();
+
+ArenaStats getArenaStats();
+void printArenaStats();
+
+// Per-image scratch memory. The arena of the thread is rewound when the outermost
+// scope ends. Mats that outlive the scope keep their chunk until they are released.
+class ArenaScope
+{
+public:
+    ArenaScope();
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    bool isActive;
+};
@@ -0,0 +1,671 @@
+#include "benchmarks.h"
+#include "ioUtils.h"
+#include "imageUtils.h"
+#include "annotations.h"
+#include "imageSource.h"
+#include "evaluation.h"
+#include "classifier.h"
+#include "descriptorTransform.h"
+#include "sgdTrainer.h"
+#include "arenaAllocator.h"
+#include "memoryStats.h"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+int benchVideoMain(
+    std::string imagesDir,
+    std::string paramsFile,
+    std::string classifierCoefficientsFile,
+    const VideoDetectionOptions &options)
+{
+    const std::string videoFile = "bench_video.avi";
+    const std::string outputFile = "bench_video.txt";
+    const cv::Size frameSize(320, 240);
+
+    std::vector<std::string> images = getImagesSorted(imagesDir);
+    cv::VideoWriter video(videoFile, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 25, frameSize);
+    if (!video.isOpened())
+    {
+        std::cout << "Cannot create video " << videoFile << std::endl;
+        return 1;
+    }
+
+    for (auto b = images.begin(), e = images.end(); b != e; b++)
+    {
+        std::string imagePath = combinePath(imagesDir, *b);
+        cv::Mat image = cv::imread(imagePath);
+        if (image.empty())
+        {
+            std::cout << "Cannot open image " << imagePath << std::endl;
+            return 1;
+        }
+
+        cv::Mat frame;
+        imresizeContain(image, frame, frameSize);
+        video.write(frame);
+    }
+    video.release();
+
+    std::cout << "Video of " << images.size() << " frames written to " << videoFile << std::endl;
+
+    PeopleClassifier classifier;
+    if (classifier.load(classifierCoefficientsFile) != 0)
+    {
+        return 1;
+    }
+
+    cv::FileStorage params(paramsFile, cv::FileStorage::READ);
+    cv::HOGDescriptor hog;
+    createHog(params, hog);
+
+    return detectVideo(classifier, hog, videoFile, outputFile, options);
+}
+
+int benchRawMain(
+    std::string imagesDir,
+    std::string paramsFile,
+    std::string classifierCoefficientsFile)
+{
+    PeopleClassifier classifier;
+    if (classifier.load(classifierCoefficientsFile) != 0)
+    {
+        return 1;
+    }
+
+    cv::FileStorage params(paramsFile, cv::FileStorage::READ);
+    cv::HOGDescriptor hog;
+    createHog(params, hog);
+
+    std::vector<std::string> images = getImagesSorted(imagesDir);
+    int mismatches = 0;
+    for (auto b = images.begin(), e = images.end(); b != e; b++)
+    {
+        std::string imagePath = combinePath(imagesDir, *b);
+        cv::Mat grayscaleImage = cv::imread(imagePath, cv::ImreadModes::IMREAD_GRAYSCALE);
+        if (grayscaleImage.empty())
+        {
+            std::cout << "Cannot open image " << imagePath << std::endl;
+            return 1;
+        }
+
+        // Padded rows like the ones capture devices hand out
+        int width = grayscaleImage.cols;
+        int height = grayscaleImage.rows;
+        int stride = (width + 63) / 64 * 64;
+        std::vector<unsigned char> frame(stride * height + stride * ((height + 1) / 2), 128);
+        for (int y = 0; y < height; y++)
+        {
+            std::memcpy(&frame[y * stride], grayscaleImage.ptr(y), width);
+        }
+        std::vector<unsigned char> original = frame;
+
+        std::vector<cv::Rect> rawBoxes;
+        if (detectPeopleRaw(classifier, hog, frame.data(), width, height, stride, PIXEL_FORMAT_NV12, rawBoxes) != 0)
+        {
+            std::cout << "Error during detection" << std::endl;
+            return 1;
+        }
+
+        if (frame != original)
+        {
+            std::cout << "Raw frame buffer was modified on " << *b << std::endl;
+            return 1;
+        }
+
+        std::vector<cv::Rect> decodedBoxes;
+        if (detectPeople(classifier, hog, grayscaleImage, decodedBoxes) != 0)
+        {
+            std::cout << "Error during detection" << std::endl;
+            return 1;
+        }
+        if (rawBoxes != decodedBoxes)
+        {
+            std::cout << "Raw frame boxes differ on " << *b << std::endl;
+            mismatches++;
+        }
+    }
+
+    std::cout << "Raw frames checked: " << images.size() << ", mismatches: " << mismatches << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Parser used before annotations were memory mapped, kept as the baseline
+static int readAnnotationsStream(const std::string file, std::vector<ImageAnnotation> &result)
+{
+    std::ifstream f;
+    f.open(file);
+    if (!f.is_open())
+    {
+        std::cout << "Can't open annotations file " << file << std::endl;
+        return 1;
+    }
+
+    while (true)
+    {
+        std::string imageFileName;
+        int x1, y1, x2, y2;
+        f >> imageFileName;
+        f >> y1;
+        f >> x1;
+        f >> y2;
+        f >> x2;
+
+        if (f.eof())
+        {
+            f.close();
+            return 0;
+        }
+
+        ImageAnnotation annotation;
+        annotation.FileName = imageFileName + ".jpg";
+        annotation.Bbox = cv::Rect(x1, y1, x2 - x1, y2 - y1);
+        result.push_back(annotation);
+    }
+}
+
+int benchAnnotationsMain(int linesCount)
+{
+    const std::string annotationsFile = "bench_annotations.txt";
+
+    std::ofstream f;
+    f.open(annotationsFile);
+    if (!f.is_open())
+    {
+        std::cout << "Can't open file to save annotations " << annotationsFile << std::endl;
+        return 1;
+    }
+    cv::RNG rng(5346654);
+    for (int i = 0; i < linesCount; i++)
+    {
+        int y1 = rng.uniform(0, 400);
+        int x1 = rng.uniform(0, 400);
+        f << "2007_" << i / 3
+          << '\t' << y1
+          << '\t' << x1
+          << '\t' << y1 + rng.uniform(1, 200)
+          << '\t' << x1 + rng.uniform(1, 200)
+          << '\n';
+    }
+    f.close();
+
+    cv::TickMeter timer;
+
+    std::vector<ImageAnnotation> streamAnnotations;
+    timer.start();
+    if (readAnnotationsStream(annotationsFile, streamAnnotations) != 0)
+    {
+        return 1;
+    }
+    timer.stop();
+    std::cout << "iostream parser : " << timer.getTimeMilli() << " ms, " << streamAnnotations.size() << " annotations" << std::endl;
+    streamAnnotations = std::vector<ImageAnnotation>();
+
+    AnnotationColumns columns;
+    timer.reset();
+    timer.start();
+    if (readAnnotationColumns(annotationsFile, columns) != 0)
+    {
+        return 1;
+    }
+    timer.stop();
+    std::cout << "mapped columns  : " << timer.getTimeMilli() << " ms, " << columns.FileIds.size() << " annotations, "
+              << columns.FileNames.size() << " files" << std::endl;
+    columns = AnnotationColumns();
+
+    std::vector<ImageAnnotation> annotations;
+    timer.reset();
+    timer.start();
+    if (readAnnotations(annotationsFile, annotations) != 0)
+    {
+        return 1;
+    }
+    timer.stop();
+    std::cout << "readAnnotations : " << timer.getTimeMilli() << " ms, " << annotations.size() << " annotations" << std::endl;
+
+    return 0;
+}
+
+static int readAllImages(const ImageSource &images, double &elapsedMilliseconds)
+{
+    cv::TickMeter timer;
+    timer.start();
+    const std::vector<std::string> &imageFiles = images.getImageFiles();
+    for (int i = 0; i < imageFiles.size(); i++)
+    {
+        cv::Mat image;
+        if (images.readGrayscale(imageFiles[i], image) != 0)
+        {
+            std::cout << "Cannot open image " << images.getImagePath(imageFiles[i]) << std::endl;
+            return 1;
+        }
+    }
+    timer.stop();
+    elapsedMilliseconds = timer.getTimeMilli();
+    return 0;
+}
+
+int benchPackMain(std::string imagesDir)
+{
+    const std::string archiveFile = "bench_images.pack";
+    if (packImages(imagesDir, archiveFile) != 0)
+    {
+        return 1;
+    }
+
+    ImageSource directory;
+    ImageSource archive;
+    if (directory.open(imagesDir) != 0 || archive.open(archiveFile) != 0)
+    {
+        return 1;
+    }
+
+    double directoryTime, archiveTime;
+    if (readAllImages(directory, directoryTime) != 0 || readAllImages(archive, archiveTime) != 0)
+    {
+        return 1;
+    }
+
+    int count = directory.getImageFiles().size();
+    std::cout << "Directory : " << directoryTime << " ms, " << directoryTime / count << " ms per image" << std::endl;
+    std::cout << "Archive   : " << archiveTime << " ms, " << archiveTime / count << " ms per image" << std::endl;
+    return 0;
+}
+
+// Per image loop used before the grid matcher, kept as the baseline
+static int64_t countTruePositivesAllPairs(const GroupedAnnotations &grouped)
+{
+    int64_t truePositives = 0;
+    for (int image = 0; image < grouped.ImagesCount; image++)
+    {
+        for (int di = grouped.DetectedOffsets[image]; di < grouped.DetectedOffsets[image + 1]; di++)
+        {
+            for (int ai = grouped.ActualOffsets[image]; ai < grouped.ActualOffsets[image + 1]; ai++)
+            {
+                cv::Rect actualBox = grouped.ActualBoxes[ai];
+                if ((actualBox & grouped.DetectedBoxes[di]).area() >= actualBox.area() / 2)
+                {
+                    truePositives++;
+                    break;
+                }
+            }
+        }
+    }
+    return truePositives;
+}
+
+int benchMatcherMain()
+{
+    const int imagesCount = 20;
+    const int boxesPerImage = 1000;
+    const int imageSide = 4000;
+
+    cv::RNG rng(5346654);
+    std::vector<ImageAnnotation> actual;
+    std::vector<ImageAnnotation> detected;
+    for (int image = 0; image < imagesCount; image++)
+    {
+        std::string fileName = "crowd_" + std::to_string(image) + ".jpg";
+        for (int i = 0; i < boxesPerImage; i++)
+        {
+            ImageAnnotation person;
+            person.FileName = fileName;
+            person.Bbox = cv::Rect(rng.uniform(0, imageSide), rng.uniform(0, imageSide), rng.uniform(20, 80), rng.uniform(40, 160));
+            actual.push_back(person);
+
+            // Most detections are shifted people, the rest are anywhere
+            ImageAnnotation detection = person;
+            if (rng.uniform(0, 5) == 0)
+            {
+                detection.Bbox.x = rng.uniform(0, imageSide);
+                detection.Bbox.y = rng.uniform(0, imageSide);
+            }
+            detection.Bbox.x += rng.uniform(-10, 11);
+            detection.Bbox.y += rng.uniform(-10, 11);
+            detection.Score = rng.uniform(-1.0f, 1.0f);
+            detected.push_back(detection);
+        }
+    }
+
+    cv::TickMeter timer;
+    GroupedAnnotations grouped;
+    timer.start();
+    groupAnnotationsByImage(actual, detected, grouped);
+    timer.stop();
+    std::cout << "Grouping      : " << timer.getTimeMilli() << " ms" << std::endl;
+
+    timer.reset();
+    timer.start();
+    int64_t allPairsTruePositives = countTruePositivesAllPairs(grouped);
+    timer.stop();
+    std::cout << "All pairs     : " << timer.getTimeMilli() << " ms, " << allPairsTruePositives << " true positives" << std::endl;
+
+    timer.reset();
+    timer.start();
+    EvaluationResult half = evaluateDetections(actual, detected, MATCH_HALF_ACTUAL_AREA);
+    timer.stop();
+    std::cout << "Grid half area: " << timer.getTimeMilli() << " ms, " << half.TruePositives << " true positives" << std::endl;
+
+    timer.reset();
+    timer.start();
+    EvaluationResult iou = evaluateDetections(actual, detected, MATCH_IOU);
+    timer.stop();
+    std::cout << "Grid IoU      : " << timer.getTimeMilli() << " ms, " << iou.TruePositives << " true positives" << std::endl;
+
+    if (half.TruePositives != allPairsTruePositives)
+    {
+        std::cout << "Grid matcher differs from the all pairs loop" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static double measureWindowsPerSecond(const std::function<void()> &scoreAll, int windowsCount)
+{
+    const int repeats = 20;
+    cv::TickMeter timer;
+    timer.start();
+    for (int i = 0; i < repeats; i++)
+    {
+        scoreAll();
+    }
+    timer.stop();
+    return repeats * windowsCount / timer.getTimeSec();
+}
+
+// Windows of a descriptor file split at random into train and validation ones
+struct BenchWindows
+{
+    cv::Mat TrainSamples;
+    std::vector<int> TrainLabels;
+    cv::Mat ValidationSamples;
+    std::vector<int> ValidationLabels;
+};
+
+static int readBenchWindows(const std::string descriptorsFile, BenchWindows &windows)
+{
+    const uint64_t maxWindows = 20000;
+    const double trainShare = 0.7;
+
+    DescriptorFile file;
+    if (file.open(descriptorsFile) != 0)
+    {
+        return 1;
+    }
+    int dims = file.getDims();
+    uint64_t stride = std::max<uint64_t>(1, file.getCount() / maxWindows);
+
+    cv::RNG rng(5346654);
+    for (uint64_t i = 0; i < file.getCount(); i += stride)
+    {
+        const float *record = file.getRecords(i);
+        cv::Mat descriptor(1, dims, CV_32F, const_cast<float *>(record));
+        int label = record[dims] > 0 ? Label::LABEL_PERSON : Label::LABEL_BACKGROUND;
+        bool isTrain = rng.uniform(0.0, 1.0) < trainShare;
+        (isTrain ? windows.TrainSamples : windows.ValidationSamples).push_back(descriptor);
+        (isTrain ? windows.TrainLabels : windows.ValidationLabels).push_back(label);
+    }
+    if (windows.TrainSamples.empty() || windows.ValidationSamples.empty())
+    {
+        std::cout << "Not enough windows in " << descriptorsFile << std::endl;
+        return 1;
+    }
+    std::cout << windows.TrainSamples.rows << " train and " << windows.ValidationSamples.rows << " validation windows" << std::endl;
+    return 0;
+}
+
+static double measureAccuracy(const std::vector<float> &scores, const std::vector<int> &labels, float threshold)
+{
+    int correct = 0;
+    for (int i = 0; i < scores.size(); i++)
+    {
+        bool isPerson = labels[i] == Label::LABEL_PERSON;
+        correct += (scores[i] > threshold) == isPerson ? 1 : 0;
+    }
+    return static_cast<double>(correct) / scores.size();
+}
+
+static TransformOptions noTransformOptions()
+{
+    TransformOptions options;
+    options.PcaComponents = 0;
+    options.PcaVariance = 0;
+    options.RffComponents = 0;
+    options.RffGamma = 0;
+    options.Seed = 5346654;
+    return options;
+}
+
+int benchPcaMain(std::string descriptorsFile)
+{
+    const double C = 0.01;
+    const int dimensions[] = {0, 256, 128, 64, 32};
+
+    BenchWindows windows;
+    if (readBenchWindows(descriptorsFile, windows) != 0)
+    {
+        return 1;
+    }
+    const cv::Mat &trainSamples = windows.TrainSamples;
+    const cv::Mat &validationSamples = windows.ValidationSamples;
+    int dims = trainSamples.cols;
+
+    std::string modelFile = descriptorsFile + ".pca.yml";
+    for (int components : dimensions)
+    {
+        if (components >= dims)
+        {
+            continue;
+        }
+
+        TransformOptions options = noTransformOptions();
+        options.PcaComponents = components;
+        DescriptorTransform transform;
+        transform.configure(options);
+        if (transform.needsFit())
+        {
+            transform.fit(trainSamples);
+        }
+
+        cv::Mat trainCompressed;
+        cv::Mat validationCompressed;
+        transform.apply(trainSamples, trainCompressed);
+        transform.apply(validationSamples, validationCompressed);
+
+        auto svm = cv::ml::SVM::create();
+        svm->setType(cv::ml::SVM::C_SVC);
+        svm->setKernel(cv::ml::SVM::LINEAR);
+        svm->setC(C);
+        svm->train(trainCompressed, cv::ml::ROW_SAMPLE, windows.TrainLabels);
+        svm->save(modelFile);
+        if (transform.appendTo(modelFile) != 0)
+        {
+            return 1;
+        }
+
+        // Loading folds the projection into weights over raw descriptors
+        PeopleClassifier classifier;
+        if (classifier.load(modelFile) != 0)
+        {
+            return 1;
+        }
+        std::vector<float> scores;
+        classifier.score(validationSamples, scores);
+
+        // Scoring stored compressed windows against projecting raw ones on the fly
+        cv::Mat results;
+        cv::Mat weights = cv::Mat::ones(1, validationCompressed.cols, CV_32F);
+        double compressedRate = measureWindowsPerSecond([&]()
+        {
+            cv::gemm(validationCompressed, weights, 1, cv::noArray(), 0, results, cv::GEMM_2_T);
+        }, validationCompressed.rows);
+        double fusedRate = measureWindowsPerSecond([&]()
+        {
+            cv::Mat projected;
+            transform.apply(validationSamples, projected);
+            cv::gemm(projected, weights, 1, cv::noArray(), 0, results, cv::GEMM_2_T);
+        }, validationSamples.rows);
+
+        std::cout << (components == 0 ? "full" : std::to_string(components)) << " dims: "
+                  << validationCompressed.cols * sizeof(float) << " bytes per window, "
+                  << compressedRate / 1e6 << " M windows/s compressed, "
+                  << fusedRate / 1e6 << " M windows/s projected from raw, accuracy "
+                  << measureAccuracy(scores, windows.ValidationLabels, classifier.getThreshold()) << std::endl;
+    }
+    std::remove(modelFile.c_str());
+    return 0;
+}
+
+int benchRffMain(std::string descriptorsFile, std::string paramsFile)
+{
+    const double C = 1;
+    const int featureCounts[] = {256, 512, 1024, 2048, 4096};
+
+    cv::FileStorage params(paramsFile, cv::FileStorage::READ);
+    TransformOptions paramsOptions = readTransformOptions(params);
+    double gamma = paramsOptions.RffGamma > 0 ? paramsOptions.RffGamma : 0.1;
+
+    BenchWindows windows;
+    if (readBenchWindows(descriptorsFile, windows) != 0)
+    {
+        return 1;
+    }
+
+    cv::TickMeter trainTimer;
+    trainTimer.start();
+    auto rbf = cv::ml::SVM::create();
+    rbf->setType(cv::ml::SVM::C_SVC);
+    rbf->setKernel(cv::ml::SVM::RBF);
+    rbf->setGamma(gamma);
+    rbf->setC(C);
+    rbf->train(windows.TrainSamples, cv::ml::ROW_SAMPLE, windows.TrainLabels);
+    trainTimer.stop();
+
+    cv::TickMeter scoreTimer;
+    scoreTimer.start();
+    cv::Mat rbfResults;
+    rbf->predict(windows.ValidationSamples, rbfResults, cv::ml::StatModel::RAW_OUTPUT);
+    scoreTimer.stop();
+    std::vector<float> scores(rbfResults.ptr<float>(), rbfResults.ptr<float>() + rbfResults.rows);
+    std::cout << "Exact RBF, gamma " << gamma << ": train " << trainTimer.getTimeMilli() << " ms, score "
+              << scoreTimer.getTimeMilli() << " ms, " << rbf->getSupportVectors().rows << " support vectors, accuracy "
+              << measureAccuracy(scores, windows.ValidationLabels, 0) << std::endl;
+
+    std::string modelFile = descriptorsFile + ".rff.yml";
+    for (int features : featureCounts)
+    {
+        TransformOptions options = noTransformOptions();
+        options.RffComponents = features;
+        options.RffGamma = gamma;
+        options.Seed = paramsOptions.Seed;
+
+        trainTimer.reset();
+        trainTimer.start();
+        DescriptorTransform transform;
+        transform.configure(options);
+        transform.fit(windows.TrainSamples);
+        cv::Mat trainFeatures;
+        transform.apply(windows.TrainSamples, trainFeatures);
+
+        auto svm = cv::ml::SVM::create();
+        svm->setType(cv::ml::SVM::C_SVC);
+        svm->setKernel(cv::ml::SVM::LINEAR);
+        svm->setC(C);
+        svm->train(trainFeatures, cv::ml::ROW_SAMPLE, windows.TrainLabels);
+        trainTimer.stop();
+
+        svm->save(modelFile);
+        if (transform.appendTo(modelFile) != 0)
+        {
+            return 1;
+        }
+        PeopleClassifier classifier;
+        if (classifier.load(modelFile) != 0)
+        {
+            return 1;
+        }
+
+        // Scoring includes the features of raw descriptors, as in detection
+        scoreTimer.reset();
+        scoreTimer.start();
+        classifier.score(windows.ValidationSamples, scores);
+        scoreTimer.stop();
+        std::cout << features << " features: train " << trainTimer.getTimeMilli() << " ms, score "
+                  << scoreTimer.getTimeMilli() << " ms, accuracy "
+                  << measureAccuracy(scores, windows.ValidationLabels, classifier.getThreshold()) << std::endl;
+    }
+    std::remove(modelFile.c_str());
+    return 0;
+}
+
+// Black frame with people-like bright boxes of random count and sizes
+static void drawSyntheticImage(cv::RNG &rng, cv::Mat &image)
+{
+    image = cv::Mat::zeros(rng.uniform(360, 1081), rng.uniform(640, 1921), CV_8UC1);
+    int boxesCount = rng.uniform(1, 40);
+    for (int i = 0; i < boxesCount; i++)
+    {
+        cv::Rect box(rng.uniform(0, image.cols), rng.uniform(0, image.rows), rng.uniform(10, 200), rng.uniform(20, 400));
+        cv::rectangle(image, box & cv::Rect(0, 0, image.cols, image.rows), cv::Scalar(rng.uniform(30, 256)), cv::FILLED);
+    }
+}
+
+static void processSyntheticImages(int imagesCount, const cv::HOGDescriptor &hog, double &elapsedMilliseconds)
+{
+    cv::RNG rng(5346654);
+    cv::TickMeter timer;
+    std::vector<float> descriptors;
+    for (int i = 0; i < imagesCount; i++)
+    {
+        cv::Mat image;
+        drawSyntheticImage(rng, image);
+
+        timer.start();
+        ArenaScope arenaScope;
+        std::vector<cv::Rect> boxes = findBoxesOnBlackBackground(image);
+        for (int j = 0; j < boxes.size(); j++)
+        {
+            cv::Mat window;
+            imresizeContain(image(boxes[j]), window, hog.winSize);
+            hog.compute(window, descriptors);
+        }
+        timer.stop();
+    }
+    elapsedMilliseconds = timer.getTimeMilli();
+}
+
+int benchArenaMain(int imagesCount, std::string paramsFile)
+{
+    cv::FileStorage params(paramsFile, cv::FileStorage::READ);
+    cv::HOGDescriptor hog;
+    createHog(params, hog);
+    installArenaAllocator();
+
+    bool wasEnabled = isArenaEnabled();
+    for (int run = 0; run < 2; run++)
+    {
+        bool withArena = run == 1;
+        setArenaEnabled(withArena);
+        // Recorded only with the -memory flag, arena chunks count as single allocations
+        MemoryStage stage(withArena ? "bench arena" : "bench heap");
+        ArenaStats before = getArenaStats();
+        double elapsedMilliseconds;
+        processSyntheticImages(imagesCount, hog, elapsedMilliseconds);
+        ArenaStats after = getArenaStats();
+        stage.stop();
+
+        std::cout << (withArena ? "Arena: " : "Heap:  ") << elapsedMilliseconds << " ms, "
+                  << after.HeapAllocations - before.HeapAllocations << " heap Mats, "
+                  << after.ArenaAllocations - before.ArenaAllocations << " arena Mats, "
+                  << after.ChunkAllocations - before.ChunkAllocations << " chunks" << std::endl;
+    }
+    printArenaStats();
+    setArenaEnabled(wasEnabled);
+    return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include "videoDetection.h"
+
+// Renders the images directory into a local video and runs detect-video on it
+int benchVideoMain(
+    std::string imagesDir,
+    std::string paramsFile,
+    std::string classifierCoefficientsFile,
+    const VideoDetectionOptions &options);
+
+// Runs detection on NV12 copies of the images through the raw frame API and checks
+// that the caller's buffers stay untouched and boxes match the decoded image path
+int benchRawMain(
+    std::string imagesDir,
+    std::string paramsFile,
+    std::string classifierCoefficientsFile);
+
+// Compares the iostream annotations parser with the memory mapped one
+// on a synthetic file of the given number of lines
+int benchAnnotationsMain(int linesCount);
+
+// Packs the images directory and compares reading every image from the
+// directory with reading it from the memory mapped archive
+int benchPackMain(std::string imagesDir);
+
+// Compares the all pairs evaluation loop with the grid matcher on synthetic
+// crowd images of a thousand actual and a thousand detected boxes each
+int benchMatcherMain();
+
+// Trains a linear SVM with a fixed C on windows of a descriptor file written by
+// train -sgd, full and PCA compressed, and reports the stored bytes per window,
+// scoring throughput and validation accuracy of every dimension
+int benchPcaMain(std::string descriptorsFile);
+
+// Compares an exact RBF SVM with linear SVMs on random Fourier features of
+// several dimensions by train time, scoring time and validation accuracy.
+// Windows come from a descriptor file, the kernel width from rffGamma.
+int benchRffMain(std::string descriptorsFile, std::string paramsFile);
+
+// Runs proposals and window descriptors on synthetic images of varying content,
+// first with heap Mats and then with per-image arenas, and compares allocations
+int benchArenaMain(int imagesCount, std::string paramsFile);
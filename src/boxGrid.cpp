@@ -0,0 +1,229 @@
+#include "boxGrid.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+
+// Grid boxes a cell holds on average before the grid gets denser
+const int BOXES_PER_CELL = 4;
+
+void computeIntersectionAreas(
+    const cv::Rect &box,
+    const int *x1,
+    const int *y1,
+    const int *x2,
+    const int *y2,
+    int count,
+    int *areas)
+{
+    const int boxX1 = box.x;
+    const int boxY1 = box.y;
+    const int boxX2 = box.x + box.width;
+    const int boxY2 = box.y + box.height;
+
+    int i = 0;
+#if CV_SIMD
+    const cv::v_int32 vBoxX1 = cv::vx_setall_s32(boxX1);
+    const cv::v_int32 vBoxY1 = cv::vx_setall_s32(boxY1);
+    const cv::v_int32 vBoxX2 = cv::vx_setall_s32(boxX2);
+    const cv::v_int32 vBoxY2 = cv::vx_setall_s32(boxY2);
+    const cv::v_int32 zero = cv::vx_setzero_s32();
+    for (; i <= count - cv::v_int32::nlanes; i += cv::v_int32::nlanes)
+    {
+        cv::v_int32 width = cv::v_min(cv::vx_load(x2 + i), vBoxX2) - cv::v_max(cv::vx_load(x1 + i), vBoxX1);
+        cv::v_int32 height = cv::v_min(cv::vx_load(y2 + i), vBoxY2) - cv::v_max(cv::vx_load(y1 + i), vBoxY1);
+        cv::v_store(areas + i, cv::v_max(width, zero) * cv::v_max(height, zero));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        int width = std::min(x2[i], boxX2) - std::max(x1[i], boxX1);
+        int height = std::min(y2[i], boxY2) - std::max(y1[i], boxY1);
+        areas[i] = std::max(width, 0) * std::max(height, 0);
+    }
+}
+
+void BoxGrid::build(const cv::Rect *boxes, int count)
+{
+    cellOffsets.clear();
+    indices.clear();
+    x1.clear();
+    y1.clear();
+    x2.clear();
+    y2.clear();
+    boxAreas.clear();
+    hasDegenerateBoxes = false;
+    cellsX = 0;
+    cellsY = 0;
+    if (count == 0)
+    {
+        return;
+    }
+
+    cv::Rect bounds = boxes[0];
+    long long widthsSum = 0;
+    long long heightsSum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        bounds |= boxes[i];
+        widthsSum += std::max(boxes[i].width, 1);
+        heightsSum += std::max(boxes[i].height, 1);
+        hasDegenerateBoxes = hasDegenerateBoxes || boxes[i].area() / 2 <= 0;
+    }
+
+    // Cells no smaller than an average box, so a box lands in few cells
+    int maxCells = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(count) / BOXES_PER_CELL)));
+    int averageWidth = static_cast<int>(widthsSum / count);
+    int averageHeight = static_cast<int>(heightsSum / count);
+    origin = bounds.tl();
+    cellsX = std::max(1, std::min(maxCells, bounds.width / averageWidth));
+    cellsY = std::max(1, std::min(maxCells, bounds.height / averageHeight));
+    cellSize.width = std::max(1, (bounds.width + cellsX - 1) / cellsX);
+    cellSize.height = std::max(1, (bounds.height + cellsY - 1) / cellsY);
+
+    std::vector<cv::Rect> boxCells(count);
+    cellOffsets.assign(cellsX * cellsY + 1, 0);
+    for (int i = 0; i < count; i++)
+    {
+        if (!findCells(boxes[i], boxCells[i]))
+        {
+            boxCells[i] = cv::Rect();
+        }
+        for (int cy = boxCells[i].y; cy < boxCells[i].y + boxCells[i].height; cy++)
+        {
+            for (int cx = boxCells[i].x; cx < boxCells[i].x + boxCells[i].width; cx++)
+            {
+                cellOffsets[cy * cellsX + cx + 1]++;
+            }
+        }
+    }
+    for (int cell = 0; cell < cellsX * cellsY; cell++)
+    {
+        cellOffsets[cell + 1] += cellOffsets[cell];
+    }
+
+    int entriesCount = cellOffsets.back();
+    indices.resize(entriesCount);
+    x1.resize(entriesCount);
+    y1.resize(entriesCount);
+    x2.resize(entriesCount);
+    y2.resize(entriesCount);
+    boxAreas.resize(entriesCount);
+    std::vector<int> positions(cellOffsets.begin(), cellOffsets.end() - 1);
+    for (int i = 0; i < count; i++)
+    {
+        for (int cy = boxCells[i].y; cy < boxCells[i].y + boxCells[i].height; cy++)
+        {
+            for (int cx = boxCells[i].x; cx < boxCells[i].x + boxCells[i].width; cx++)
+            {
+                int entry = positions[cy * cellsX + cx]++;
+                indices[entry] = i;
+                x1[entry] = boxes[i].x;
+                y1[entry] = boxes[i].y;
+                x2[entry] = boxes[i].x + boxes[i].width;
+                y2[entry] = boxes[i].y + boxes[i].height;
+                boxAreas[entry] = boxes[i].area();
+            }
+        }
+    }
+}
+
+// Range of cells overlapped by the box, false if it is outside of the grid
+bool BoxGrid::findCells(const cv::Rect &box, cv::Rect &cells) const
+{
+    if (cellsX == 0 || box.width <= 0 || box.height <= 0)
+    {
+        return false;
+    }
+
+    int left = box.x - origin.x;
+    int top = box.y - origin.y;
+    int right = left + box.width - 1;
+    int bottom = top + box.height - 1;
+    if (right < 0 || bottom < 0 || left >= cellsX * cellSize.width || top >= cellsY * cellSize.height)
+    {
+        return false;
+    }
+
+    int cx1 = std::max(left, 0) / cellSize.width;
+    int cy1 = std::max(top, 0) / cellSize.height;
+    int cx2 = std::min(right / cellSize.width, cellsX - 1);
+    int cy2 = std::min(bottom / cellSize.height, cellsY - 1);
+    cells = cv::Rect(cx1, cy1, cx2 - cx1 + 1, cy2 - cy1 + 1);
+    return true;
+}
+
+void BoxGrid::computeCellAreas(const cv::Rect &box, int cell, std::vector<int> &areas) const
+{
+    int begin = cellOffsets[cell];
+    int count = cellOffsets[cell + 1] - begin;
+    areas.resize(count);
+    computeIntersectionAreas(box, &x1[begin], &y1[begin], &x2[begin], &y2[begin], count, areas.data());
+}
+
+bool BoxGrid::coversHalfOfAny(const cv::Rect &box) const
+{
+    if (hasDegenerateBoxes)
+    {
+        return true;
+    }
+
+    cv::Rect cells;
+    if (!findCells(box, cells))
+    {
+        return false;
+    }
+    for (int cy = cells.y; cy < cells.y + cells.height; cy++)
+    {
+        for (int cx = cells.x; cx < cells.x + cells.width; cx++)
+        {
+            int cell = cy * cellsX + cx;
+            computeCellAreas(box, cell, areasBuffer);
+            const int *cellAreas = &boxAreas[cellOffsets[cell]];
+            for (int i = 0; i < areasBuffer.size(); i++)
+            {
+                if (areasBuffer[i] >= cellAreas[i] / 2)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+int BoxGrid::findBestIou(const cv::Rect &box, const std::vector<unsigned char> &isMatched, float minIou) const
+{
+    cv::Rect cells;
+    if (!findCells(box, cells))
+    {
+        return -1;
+    }
+
+    int best = -1;
+    float bestIou = minIou;
+    int area = box.area();
+    for (int cy = cells.y; cy < cells.y + cells.height; cy++)
+    {
+        for (int cx = cells.x; cx < cells.x + cells.width; cx++)
+        {
+            int cell = cy * cellsX + cx;
+            computeCellAreas(box, cell, areasBuffer);
+            int begin = cellOffsets[cell];
+            for (int i = 0; i < areasBuffer.size(); i++)
+            {
+                int index = indices[begin + i];
+                if (areasBuffer[i] == 0 || isMatched[index])
+                {
+                    continue;
+                }
+                float iou = static_cast<float>(areasBuffer[i]) / (area + boxAreas[begin + i] - areasBuffer[i]);
+                if (iou > bestIou || (iou == bestIou && (best < 0 || index < best)))
+                {
+                    bestIou = iou;
+                    best = index;
+                }
+            }
+        }
+    }
+    return best;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <opencv2/core/types.hpp>
+
+// Intersection areas of a box with boxes given column by column, vectorized
+// with universal intrinsics. Empty intersections have zero area.
+void computeIntersectionAreas(
+    const cv::Rect &box,
+    const int *x1,
+    const int *y1,
+    const int *x2,
+    const int *y2,
+    int count,
+    int *areas);
+
+// Boxes of one image bucketed into a uniform grid. A box is stored in every
+// cell it overlaps, cells keep their boxes column by column, so a query only
+// tests the boxes of the cells it touches. Queries share a buffer, so a grid
+// belongs to a single thread.
+class BoxGrid
+{
+public:
+    void build(const cv::Rect *boxes, int count);
+
+    // Whether the box covers at least half of the area of some grid box
+    bool coversHalfOfAny(const cv::Rect &box) const;
+
+    // Index of the unmatched grid box with the highest IoU not lower than minIou, or -1
+    int findBestIou(const cv::Rect &box, const std::vector<unsigned char> &isMatched, float minIou) const;
+
+private:
+    bool findCells(const cv::Rect &box, cv::Rect &cells) const;
+    void computeCellAreas(const cv::Rect &box, int cell, std::vector<int> &areas) const;
+
+    cv::Point origin;
+    cv::Size cellSize;
+    int cellsX;
+    int cellsY;
+    bool hasDegenerateBoxes; // Half of their area isn't positive, so any box covers it
+    std::vector<int> cellOffsets;
+    std::vector<int> indices;
+    std::vector<int> x1;
+    std::vector<int> y1;
+    std::vector<int> x2;
+    std::vector<int> y2;
+    std::vector<int> boxAreas;
+    mutable std::vector<int> areasBuffer;
+};
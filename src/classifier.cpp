@@ -0,0 +1,141 @@
+#include "classifier.h"
+#include <iostream>
+
+PeopleClassifier::PeopleClassifier()
+    : bias(0), threshold(0), useQuantized(false)
+{
+}
+
+int PeopleClassifier::load(const std::string file)
+{
+    svm = cv::ml::SVM::load(file);
+    if (svm.empty() || !svm->isTrained())
+    {
+        std::cout << "Can't load classifier " << file << std::endl;
+        return 1;
+    }
+
+    cv::FileStorage fs(file, cv::FileStorage::READ);
+    transform.read(fs);
+    prepareDecisionFunction();
+
+    // Int8 scores skip the transform, so it must have been folded
+    useQuantized = false;
+    quantizedModel = QuantizedLinearModel();
+    if (!weights.empty() && transform.isIdentity())
+    {
+        quantizedModel.read(fs, weights, bias);
+    }
+
+    return 0;
+}
+
+int PeopleClassifier::create(const cv::Ptr<cv::ml::SVM> &trainedSvm)
+{
+    if (trainedSvm.empty() || !trainedSvm->isTrained())
+    {
+        std::cout << "Classifier isn't trained" << std::endl;
+        return 1;
+    }
+
+    svm = trainedSvm;
+    transform = DescriptorTransform();
+    prepareDecisionFunction();
+    useQuantized = false;
+    quantizedModel = QuantizedLinearModel();
+    return 0;
+}
+
+void PeopleClassifier::prepareDecisionFunction()
+{
+    weights.release();
+    bias = 0;
+    if (svm->getKernelType() == cv::ml::SVM::LINEAR)
+    {
+        // Linear models keep a single compressed support vector, so the
+        // decision value is one dot product: alpha * sv . x - rho
+        cv::Mat supportVectors = svm->getSupportVectors();
+        cv::Mat alpha;
+        cv::Mat supportVectorIndices;
+        double rho = svm->getDecisionFunction(0, alpha, supportVectorIndices);
+        alpha.convertTo(alpha, CV_32F);
+        weights = cv::Mat::zeros(1, supportVectors.cols, CV_32F);
+        for (int i = 0; i < supportVectorIndices.total(); i++)
+        {
+            weights += alpha.at<float>(i) * supportVectors.row(supportVectorIndices.at<int>(i));
+        }
+        bias = static_cast<float>(-rho);
+
+        cv::Mat foldedWeights;
+        float foldedBias;
+        if (transform.foldLinear(weights, bias, foldedWeights, foldedBias))
+        {
+            weights = foldedWeights;
+            bias = foldedBias;
+            transform = DescriptorTransform();
+        }
+    }
+}
+
+void PeopleClassifier::setThreshold(float threshold)
+{
+    this->threshold = threshold;
+}
+
+float PeopleClassifier::getThreshold() const
+{
+    return threshold;
+}
+
+int PeopleClassifier::setQuantized(bool quantized)
+{
+    if (quantized && quantizedModel.empty())
+    {
+        std::cout << "Classifier has no int8 calibration, train it again" << std::endl;
+        return 1;
+    }
+    useQuantized = quantized;
+    return 0;
+}
+
+bool PeopleClassifier::getLinearModel(cv::Mat &weights, float &bias) const
+{
+    if (this->weights.empty() || !transform.isIdentity())
+    {
+        return false;
+    }
+    weights = this->weights;
+    bias = this->bias;
+    return true;
+}
+
+void PeopleClassifier::score(const cv::Mat &samples, std::vector<float> &scores) const
+{
+    if (useQuantized)
+    {
+        quantizedModel.score(samples, threshold, scores);
+        return;
+    }
+
+    cv::Mat transformed;
+    transform.apply(samples, transformed);
+
+    cv::Mat results;
+    if (!weights.empty())
+    {
+        cv::gemm(transformed, weights, 1, cv::noArray(), 0, results, cv::GEMM_2_T);
+        results += bias;
+    }
+    else
+    {
+        // For two classes the raw output is positive for the first one, people
+        svm->predict(transformed, results, cv::ml::StatModel::RAW_OUTPUT);
+    }
+
+    scores.assign(results.ptr<float>(), results.ptr<float>() + results.rows);
+}
+
+bool PeopleClassifier::isPerson(float score) const
+{
+    return score > threshold;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/ml.hpp>
+#include "descriptorTransform.h"
+#include "quantization.h"
+
+// SVM scoring HOG descriptors by their decision value. Positive scores
+// mean a person, the threshold trades recall for precision. A descriptor
+// transform saved with the model is folded into linear weights when exact.
+class PeopleClassifier
+{
+public:
+    PeopleClassifier();
+
+    int load(const std::string file);
+    // Uses an SVM trained in memory on raw descriptors
+    int create(const cv::Ptr<cv::ml::SVM> &trainedSvm);
+
+    void setThreshold(float threshold);
+    float getThreshold() const;
+
+    // Scores on int8 descriptors, needs a linear model calibrated in train
+    int setQuantized(bool quantized);
+    // Decision function on raw descriptors, returns false for other kernels
+    bool getLinearModel(cv::Mat &weights, float &bias) const;
+
+    // One score per row of samples
+    void score(const cv::Mat &samples, std::vector<float> &scores) const;
+    bool isPerson(float score) const;
+
+private:
+    cv::Ptr<cv::ml::SVM> svm;
+    DescriptorTransform transform; // Applied before predict when it can't be folded
+    cv::Mat weights; // Single row of the linear decision function, empty for other kernels
+    float bias;
+    float threshold;
+    QuantizedLinearModel quantizedModel; // Empty if the model file has no int8 calibration
+    bool useQuantized;
+
+    // Folds linear models into weights and bias after svm and transform are set
+    void prepareDecisionFunction();
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Fixed capacity FIFO shared between producer and consumer threads.
+// After close() producers are rejected and consumers drain what is left.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false)
+    {
+    }
+
+    // Waits for a free slot, returns false if the queue was closed meanwhile
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]
+                     { return closed || items.size() < capacity; });
+        if (closed)
+        {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Never waits, returns false if the queue is full or closed
+    bool tryPush(T item)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed || items.size() >= capacity)
+        {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Waits for an item, returns false once the queue is closed and empty
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this]
+                      { return closed || !items.empty(); });
+        if (items.empty())
+        {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+};
@@ -0,0 +1,237 @@
+#include "descriptorTransform.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "sgdTrainer.h"
+
+// Records the PCA is fitted on, the covariance costs dims^2 regardless
+static const uint64_t PCA_FIT_RECORDS = 20000;
+// Records projected by a single GEMM while compressing a file
+static const int COMPRESS_BLOCK_RECORDS = 4096;
+
+TransformOptions readTransformOptions(const cv::FileStorage &params)
+{
+    TransformOptions options;
+    options.PcaComponents = params["pcaComponents"];
+    options.PcaVariance = params["pcaVariance"];
+    options.RffComponents = params["rffComponents"];
+    options.RffGamma = params["rffGamma"];
+    options.Seed = params["sampleRngSeed"];
+    return options;
+}
+
+DescriptorTransform::DescriptorTransform()
+    : hasPca(false), hasRff(false)
+{
+    options.PcaComponents = 0;
+    options.PcaVariance = 0;
+    options.RffComponents = 0;
+    options.RffGamma = 0;
+    options.Seed = 0;
+}
+
+void DescriptorTransform::configure(const TransformOptions &options)
+{
+    this->options = options;
+    hasPca = false;
+    hasRff = false;
+}
+
+bool DescriptorTransform::isIdentity() const
+{
+    return !hasPca && !hasRff;
+}
+
+bool DescriptorTransform::needsFit() const
+{
+    bool wantsPca = options.PcaComponents > 0 || options.PcaVariance > 0;
+    bool wantsRff = options.RffComponents > 0;
+    return (wantsPca && !hasPca) || (wantsRff && !hasRff);
+}
+
+void DescriptorTransform::fit(const cv::Mat &samples)
+{
+    int dims = samples.cols;
+    if (options.PcaComponents > 0 || options.PcaVariance > 0)
+    {
+        if (options.PcaComponents > 0)
+        {
+            pca = cv::PCA(samples, cv::noArray(), cv::PCA::DATA_AS_ROW, options.PcaComponents);
+        }
+        else
+        {
+            pca = cv::PCA(samples, cv::noArray(), cv::PCA::DATA_AS_ROW, options.PcaVariance);
+        }
+        hasPca = true;
+        dims = pca.eigenvectors.rows;
+        std::cout << "PCA keeps " << dims << " of " << samples.cols << " dimensions" << std::endl;
+    }
+
+    if (options.RffComponents > 0)
+    {
+        // Frequencies drawn from the Fourier transform of the RBF kernel, N(0, 2 gamma)
+        cv::RNG rng(options.Seed);
+        rffFrequencies.create(options.RffComponents, dims, CV_32F);
+        rffPhases.create(1, options.RffComponents, CV_32F);
+        rng.fill(rffFrequencies, cv::RNG::NORMAL, 0, std::sqrt(2 * options.RffGamma));
+        rng.fill(rffPhases, cv::RNG::UNIFORM, 0, 2 * CV_PI);
+        hasRff = true;
+        std::cout << "Random Fourier features: " << options.RffComponents << " of " << dims << " dimensions" << std::endl;
+    }
+}
+
+// Adds the row to every row of samples
+static void addToRows(cv::Mat &samples, const cv::Mat &row)
+{
+    for (int i = 0; i < samples.rows; i++)
+    {
+        samples.row(i) += row;
+    }
+}
+
+void DescriptorTransform::apply(const cv::Mat &samples, cv::Mat &result) const
+{
+    cv::Mat projected = samples;
+    if (hasPca)
+    {
+        // (x - mean) * E^T as one GEMM with the mean folded into a row offset
+        cv::Mat offset;
+        cv::gemm(pca.mean, pca.eigenvectors, -1, cv::noArray(), 0, offset, cv::GEMM_2_T);
+        cv::gemm(samples, pca.eigenvectors, 1, cv::noArray(), 0, projected, cv::GEMM_2_T);
+        addToRows(projected, offset);
+    }
+
+    if (!hasRff)
+    {
+        result = projected;
+        return;
+    }
+
+    // z(x) = sqrt(2 / D) cos(W x + b), the cosines come from the vectorized polarToCart
+    cv::Mat angles;
+    cv::gemm(projected, rffFrequencies, 1, cv::noArray(), 0, angles, cv::GEMM_2_T);
+    addToRows(angles, rffPhases);
+    cv::Mat sines;
+    cv::polarToCart(cv::Mat(), angles, result, sines);
+    result *= std::sqrt(2.0 / rffFrequencies.rows);
+}
+
+bool DescriptorTransform::foldLinear(const cv::Mat &weights, float bias, cv::Mat &foldedWeights, float &foldedBias) const
+{
+    if (hasRff)
+    {
+        return false;
+    }
+    if (!hasPca)
+    {
+        foldedWeights = weights;
+        foldedBias = bias;
+        return true;
+    }
+
+    // w . E (x - mean) + b = (w E) . x + b - (w E) . mean
+    foldedWeights = weights * pca.eigenvectors;
+    foldedBias = bias - static_cast<float>(foldedWeights.dot(pca.mean));
+    return true;
+}
+
+int DescriptorTransform::appendTo(const std::string modelFile) const
+{
+    if (isIdentity())
+    {
+        return 0;
+    }
+
+    cv::FileStorage fs(modelFile, cv::FileStorage::APPEND);
+    if (!fs.isOpened())
+    {
+        std::cout << "Can't open classifier " << modelFile << " to add the descriptor transform" << std::endl;
+        return 1;
+    }
+    if (hasPca)
+    {
+        fs << "people_pca" << "{";
+        pca.write(fs);
+        fs << "}";
+    }
+    if (hasRff)
+    {
+        fs << "people_rff" << "{";
+        fs << "frequencies" << rffFrequencies;
+        fs << "phases" << rffPhases;
+        fs << "}";
+    }
+    return 0;
+}
+
+void DescriptorTransform::read(const cv::FileStorage &fs)
+{
+    cv::FileNode pcaNode = fs["people_pca"];
+    hasPca = !pcaNode.empty();
+    if (hasPca)
+    {
+        pca.read(pcaNode);
+    }
+
+    cv::FileNode rffNode = fs["people_rff"];
+    hasRff = !rffNode.empty();
+    if (hasRff)
+    {
+        rffNode["frequencies"] >> rffFrequencies;
+        rffNode["phases"] >> rffPhases;
+    }
+}
+
+int compressDescriptorFile(DescriptorTransform &transform, const std::string descriptorsFile, const std::string compressedFile)
+{
+    DescriptorFile input;
+    if (input.open(descriptorsFile) != 0)
+    {
+        return 1;
+    }
+    int dims = input.getDims();
+    uint64_t count = input.getCount();
+    if (count == 0)
+    {
+        std::cout << "No descriptors in " << descriptorsFile << std::endl;
+        return 1;
+    }
+
+    if (transform.needsFit())
+    {
+        cv::Mat fitSamples;
+        input.copySample(PCA_FIT_RECORDS, fitSamples);
+        transform.fit(fitSamples);
+    }
+
+    DescriptorWriter output;
+    bool isOpened = false;
+    for (uint64_t first = 0; first < count; first += COMPRESS_BLOCK_RECORDS)
+    {
+        int blockCount = static_cast<int>(std::min<uint64_t>(count - first, COMPRESS_BLOCK_RECORDS));
+        const float *records = input.getRecords(first);
+        cv::Mat block(blockCount, dims, CV_32F, const_cast<float *>(records), (dims + 1) * sizeof(float));
+        cv::Mat transformed;
+        transform.apply(block, transformed);
+
+        if (!isOpened)
+        {
+            if (output.open(compressedFile, transformed.cols) != 0)
+            {
+                return 1;
+            }
+            isOpened = true;
+        }
+        for (int i = 0; i < blockCount; i++)
+        {
+            bool isPerson = records[i * (dims + 1) + dims] > 0;
+            if (output.write(transformed.ptr<float>(i), isPerson) != 0)
+            {
+                std::cout << "Can't write descriptors file " << compressedFile << std::endl;
+                return 1;
+            }
+        }
+        input.release(first, blockCount);
+    }
+    return output.close();
+}
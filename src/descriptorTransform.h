@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <opencv2/core/core.hpp>
+
+// Descriptor transforms configured in params.yml, 0 disables an option
+struct TransformOptions
+{
+    int PcaComponents;  // Fixed dimension of the projection
+    double PcaVariance; // Or the share of variance the projection keeps
+    int RffComponents;  // Random Fourier features approximating an RBF kernel
+    double RffGamma;    // Width of the approximated kernel exp(-gamma |x - y|^2)
+    int Seed;           // Random frequencies of the features
+};
+
+TransformOptions readTransformOptions(const cv::FileStorage &params);
+
+// Mapping of HOG descriptors applied before the SVM: an optional PCA, then
+// optional random Fourier features. It is learned in train and stored in the
+// model file next to the SVM.
+class DescriptorTransform
+{
+public:
+    DescriptorTransform();
+
+    void configure(const TransformOptions &options);
+
+    bool isIdentity() const;
+    // Configured, but not fitted or generated yet
+    bool needsFit() const;
+    void fit(const cv::Mat &samples);
+
+    // Descriptors in rows, the result may share data with samples for the identity
+    void apply(const cv::Mat &samples, cv::Mat &result) const;
+
+    // Rewrites a linear decision function on transformed descriptors as one on
+    // raw descriptors. Returns false if the transform isn't linear, as with features.
+    bool foldLinear(const cv::Mat &weights, float bias, cv::Mat &foldedWeights, float &foldedBias) const;
+
+    // Adds the transform to a saved model file
+    int appendTo(const std::string modelFile) const;
+    void read(const cv::FileStorage &fs);
+
+private:
+    TransformOptions options;
+    bool hasPca;
+    cv::PCA pca;
+    bool hasRff;
+    cv::Mat rffFrequencies; // One feature per row
+    cv::Mat rffPhases;      // Single row
+};
+
+// Fits the transform on a strided sample of a descriptor file if it needs a fit
+// and writes every record transformed into the compressed file
+int compressDescriptorFile(DescriptorTransform &transform, const std::string descriptorsFile, const std::string compressedFile);
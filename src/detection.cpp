@@ -0,0 +1,291 @@
+#include "detection.h"
+#include "imageUtils.h"
+#include "arenaAllocator.h"
+#include <iostream>
+
+void createHog(const cv::FileStorage &params, cv::HOGDescriptor &hog)
+{
+    hog.winSize = cv::Size(params["windowSizeX"], params["windowSizeY"]);
+    hog.histogramNormType = cv::HOGDescriptor::HistogramNormType::L2Hys;
+
+    hog.blockSize.width = params["blockSizeX"];
+    hog.blockSize.height = params["blockSizeY"];
+
+    hog.blockStride.width = params["blockStrideX"];
+    hog.blockStride.height = params["blockStrideY"];
+
+    hog.cellSize.width = params["cellSizeX"];
+    hog.cellSize.height = params["cellSizeY"];
+
+    hog.nbins = params["nbins"];
+    hog.derivAperture = params["derivAperture"];
+    hog.winSigma = params["winSigma"];
+    hog.L2HysThreshold = params["L2HysThreshold"];
+    hog.gammaCorrection = static_cast<int>(params["gammaCorrection"]) != 0;
+    hog.nlevels = params["nlevels"];
+    hog.signedGradient = static_cast<int>(params["signedGradient"]) != 0;
+}
+
+cv::Mat stdVectorToSamplesCvMat(std::vector<cv::Mat> &vec)
+{
+    int testDataRows = vec.size();
+    int testDataCols = vec[0].rows;
+    cv::Mat testDataMatrix(testDataRows, testDataCols, CV_32FC1);
+    cv::Mat transposeTmpMatrix(1, testDataCols, CV_32FC1);
+
+    for (size_t i = 0; i < vec.size(); i++)
+    {
+        cv::transpose(vec[i], transposeTmpMatrix);
+        transposeTmpMatrix.copyTo(testDataMatrix.row((int)i));
+    }
+
+    return testDataMatrix;
+}
+
+int detectPeople(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const cv::Mat image,
+    std::vector<cv::Rect> &locations)
+{
+    std::vector<float> scores;
+    return detectPeople(classifier, hog, image, locations, scores);
+}
+
+int detectPeople(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const cv::Mat image,
+    std::vector<cv::Rect> &locations,
+    std::vector<float> &scores)
+{
+    return detectPeopleInBoxes(classifier, hog, image, findBoxesOnBlackBackground(image), locations, scores);
+}
+
+int detectPeopleInBoxes(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const cv::Mat image,
+    const std::vector<cv::Rect> &boxes,
+    std::vector<cv::Rect> &locations,
+    std::vector<float> &scores)
+{
+    // Declared first, so every Mat of the image is released before the arena is rewound
+    ArenaScope arenaScope;
+    std::vector<float> descriptors;
+    std::vector<cv::Mat> testDataList;
+
+    if (boxes.empty())
+    {
+        // Nothing but background, e.g. a fully black video frame
+        return 0;
+    }
+
+    for (int i = 0; i < boxes.size(); i++)
+    {
+        cv::Mat imageObject = image(boxes[i]);
+        cv::Mat resizedObject;
+        imresizeContain(imageObject, resizedObject, hog.winSize);
+
+        hog.compute(resizedObject, descriptors);
+        testDataList.push_back(cv::Mat(descriptors).clone());
+    }
+
+    cv::Mat testDataMatrix = stdVectorToSamplesCvMat(testDataList);
+
+    std::vector<float> results;
+    classifier.score(testDataMatrix, results);
+
+    for (int i = 0; i < results.size() && i < boxes.size(); i++)
+    {
+        if (!classifier.isPerson(results[i]))
+        {
+            continue;
+        }
+
+        locations.push_back(boxes[i]);
+        scores.push_back(results[i]);
+    }
+
+    return 0;
+}
+
+int detectPeopleBatch(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const std::vector<cv::Mat> &images,
+    std::vector<std::vector<cv::Rect>> &locations)
+{
+    int imagesCount = static_cast<int>(images.size());
+    std::vector<std::vector<cv::Rect>> boxes(imagesCount);
+    cv::parallel_for_(cv::Range(0, imagesCount), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            boxes[i] = findBoxesOnBlackBackground(images[i]);
+        }
+    });
+
+    std::vector<std::vector<float>> scores;
+    return detectPeopleBatchInBoxes(classifier, hog, images, boxes, locations, scores);
+}
+
+int detectPeopleBatchInBoxes(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const std::vector<cv::Mat> &images,
+    const std::vector<std::vector<cv::Rect>> &boxes,
+    std::vector<std::vector<cv::Rect>> &locations,
+    std::vector<std::vector<float>> &scores)
+{
+    int imagesCount = static_cast<int>(images.size());
+    locations.assign(imagesCount, std::vector<cv::Rect>());
+    scores.assign(imagesCount, std::vector<float>());
+
+    // Windows of image i take rows [firstRows[i], firstRows[i + 1]) of the batch
+    std::vector<int> firstRows(imagesCount + 1, 0);
+    for (int i = 0; i < imagesCount; i++)
+    {
+        firstRows[i + 1] = firstRows[i] + static_cast<int>(boxes[i].size());
+    }
+    if (firstRows[imagesCount] == 0)
+    {
+        return 0;
+    }
+
+    cv::Mat testDataMatrix(firstRows[imagesCount], static_cast<int>(hog.getDescriptorSize()), CV_32FC1);
+    cv::parallel_for_(cv::Range(0, imagesCount), [&](const cv::Range &range)
+    {
+        std::vector<float> descriptors;
+        for (int i = range.start; i < range.end; i++)
+        {
+            ArenaScope arenaScope;
+            for (int j = 0; j < boxes[i].size(); j++)
+            {
+                cv::Mat resizedObject;
+                imresizeContain(images[i](boxes[i][j]), resizedObject, hog.winSize);
+                hog.compute(resizedObject, descriptors);
+                cv::Mat(1, static_cast<int>(descriptors.size()), CV_32FC1, descriptors.data()).copyTo(testDataMatrix.row(firstRows[i] + j));
+            }
+        }
+    });
+
+    std::vector<float> results;
+    classifier.score(testDataMatrix, results);
+
+    for (int i = 0; i < imagesCount; i++)
+    {
+        for (int j = 0; j < boxes[i].size(); j++)
+        {
+            float score = results[firstRows[i] + j];
+            if (classifier.isPerson(score))
+            {
+                locations[i].push_back(boxes[i][j]);
+                scores[i].push_back(score);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int detectPeopleRaw(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const unsigned char *data,
+    int width,
+    int height,
+    int stride,
+    PixelFormat format,
+    std::vector<cv::Rect> &locations)
+{
+    if (data == nullptr || width <= 0 || height <= 0 || stride < width)
+    {
+        std::cout << "Invalid raw frame " << width << "x" << height << " stride " << stride << std::endl;
+        return 1;
+    }
+
+    switch (format)
+    {
+    case PIXEL_FORMAT_GRAY8:
+    case PIXEL_FORMAT_NV12:
+    case PIXEL_FORMAT_I420:
+        break;
+    default:
+        std::cout << "Unsupported raw pixel format " << format << std::endl;
+        return 1;
+    }
+
+    // Chroma planes follow the luma one and are not needed for grayscale detection
+    const cv::Mat luma(height, width, CV_8UC1, const_cast<unsigned char *>(data), stride);
+    return detectPeople(classifier, hog, luma, locations);
+}
+
+int detectPeopleIncremental(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const cv::Mat frame,
+    IncrementalProposals &proposals,
+    std::vector<CachedWindow> &cache,
+    std::vector<cv::Rect> &locations)
+{
+    std::vector<float> descriptors;
+    std::vector<cv::Mat> testDataList;
+    std::vector<int> computedWindows;
+
+    std::vector<cv::Rect> boxes = proposals.update(frame);
+    std::vector<CachedWindow> windows(boxes.size());
+    for (int i = 0; i < boxes.size(); i++)
+    {
+        bool isReused = false;
+        if (proposals.isUnchanged(boxes[i]))
+        {
+            for (int j = 0; j < cache.size(); j++)
+            {
+                if (cache[j].Box == boxes[i])
+                {
+                    windows[i] = cache[j];
+                    isReused = true;
+                    break;
+                }
+            }
+        }
+        if (isReused)
+        {
+            continue;
+        }
+
+        cv::Mat imageObject = frame(boxes[i]);
+        cv::Mat resizedObject;
+        imresizeContain(imageObject, resizedObject, hog.winSize);
+
+        hog.compute(resizedObject, descriptors);
+        windows[i].Box = boxes[i];
+        windows[i].Descriptor = cv::Mat(descriptors).clone();
+        testDataList.push_back(windows[i].Descriptor);
+        computedWindows.push_back(i);
+    }
+
+    if (!testDataList.empty())
+    {
+        cv::Mat testDataMatrix = stdVectorToSamplesCvMat(testDataList);
+
+        std::vector<float> results;
+        classifier.score(testDataMatrix, results);
+        for (int i = 0; i < results.size() && i < computedWindows.size(); i++)
+        {
+            windows[computedWindows[i]].Score = results[i];
+        }
+    }
+
+    for (int i = 0; i < windows.size(); i++)
+    {
+        if (classifier.isPerson(windows[i].Score))
+        {
+            locations.push_back(windows[i].Box);
+        }
+    }
+    cache = windows;
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+#include "classifier.h"
+#include "incrementalProposals.h"
+
+enum Label
+{
+    LABEL_PERSON = 1,
+    LABEL_BACKGROUND = 2
+};
+
+enum PixelFormat
+{
+    PIXEL_FORMAT_GRAY8,
+    PIXEL_FORMAT_NV12,
+    PIXEL_FORMAT_I420
+};
+
+void createHog(const cv::FileStorage &params, cv::HOGDescriptor &hog);
+
+cv::Mat stdVectorToSamplesCvMat(std::vector<cv::Mat> &vec);
+
+int detectPeople(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const cv::Mat image,
+    std::vector<cv::Rect> &locations);
+
+// Same as detectPeople, also returning the decision score of every location
+int detectPeople(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const cv::Mat image,
+    std::vector<cv::Rect> &locations,
+    std::vector<float> &scores);
+
+// Same as detectPeople on proposals found beforehand, e.g. taken from a cache
+int detectPeopleInBoxes(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const cv::Mat image,
+    const std::vector<cv::Rect> &boxes,
+    std::vector<cv::Rect> &locations,
+    std::vector<float> &scores);
+
+// Detects people on several images with a single scoring call for the windows of
+// all of them. Proposals and descriptors of the images are computed in parallel.
+int detectPeopleBatch(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const std::vector<cv::Mat> &images,
+    std::vector<std::vector<cv::Rect>> &locations);
+
+// Same as detectPeopleBatch on proposals found beforehand, one list per image
+int detectPeopleBatchInBoxes(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const std::vector<cv::Mat> &images,
+    const std::vector<std::vector<cv::Rect>> &boxes,
+    std::vector<std::vector<cv::Rect>> &locations,
+    std::vector<std::vector<float>> &scores);
+
+// Detects people on a frame owned by the caller. All supported formats start with
+// the full resolution luma plane, which is wrapped without copying and never written to.
+int detectPeopleRaw(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const unsigned char *data,
+    int width,
+    int height,
+    int stride,
+    PixelFormat format,
+    std::vector<cv::Rect> &locations);
+
+// Classified window kept between video frames
+struct CachedWindow
+{
+    cv::Rect Box;
+    cv::Mat Descriptor;
+    float Score;
+};
+
+// Detects people on consecutive video frames. Windows whose pixels did not
+// change since the previous frame take descriptor and score from the cache.
+int detectPeopleIncremental(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const cv::Mat frame,
+    IncrementalProposals &proposals,
+    std::vector<CachedWindow> &cache,
+    std::vector<cv::Rect> &locations);
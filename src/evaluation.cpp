@@ -0,0 +1,239 @@
+#include "evaluation.h"
+#include "boxGrid.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+// Assigns ids in order of first appearance, names must outlive the map
+static void internFileNames(
+    const std::vector<ImageAnnotation> &annotations,
+    std::unordered_map<std::string_view, int> &ids,
+    std::vector<int> &result)
+{
+    result.resize(annotations.size());
+    for (size_t i = 0; i < annotations.size(); i++)
+    {
+        auto inserted = ids.emplace(annotations[i].FileName, static_cast<int>(ids.size()));
+        result[i] = inserted.first->second;
+    }
+}
+
+// Stable counting sort of annotations by image id, order lists their original indices
+static void groupBoxes(
+    const std::vector<ImageAnnotation> &annotations,
+    const std::vector<int> &imageIds,
+    int imagesCount,
+    std::vector<int> &offsets,
+    std::vector<int> &order)
+{
+    offsets.assign(imagesCount + 1, 0);
+    for (size_t i = 0; i < imageIds.size(); i++)
+    {
+        offsets[imageIds[i] + 1]++;
+    }
+    for (int i = 0; i < imagesCount; i++)
+    {
+        offsets[i + 1] += offsets[i];
+    }
+
+    std::vector<int> positions(offsets.begin(), offsets.end() - 1);
+    order.resize(annotations.size());
+    for (size_t i = 0; i < annotations.size(); i++)
+    {
+        order[positions[imageIds[i]]++] = static_cast<int>(i);
+    }
+}
+
+void groupAnnotationsByImage(
+    const std::vector<ImageAnnotation> &actual,
+    const std::vector<ImageAnnotation> &detected,
+    GroupedAnnotations &result)
+{
+    std::unordered_map<std::string_view, int> ids;
+    ids.reserve(actual.size() + detected.size());
+    std::vector<int> actualIds;
+    std::vector<int> detectedIds;
+    internFileNames(actual, ids, actualIds);
+    internFileNames(detected, ids, detectedIds);
+
+    result.ImagesCount = ids.size();
+    std::vector<int> order;
+    groupBoxes(actual, actualIds, result.ImagesCount, result.ActualOffsets, order);
+    result.ActualBoxes.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        result.ActualBoxes[i] = actual[order[i]].Bbox;
+    }
+
+    groupBoxes(detected, detectedIds, result.ImagesCount, result.DetectedOffsets, order);
+    result.DetectedBoxes.resize(order.size());
+    result.DetectedScores.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        result.DetectedBoxes[i] = detected[order[i]].Bbox;
+        result.DetectedScores[i] = detected[order[i]].Score;
+    }
+}
+
+const float MIN_MATCH_IOU = 0.5f;
+
+// Marks every detection matching some actual box on its image, in grouped order
+void matchDetections(const GroupedAnnotations &grouped, MatchMode mode, std::vector<unsigned char> &isCorrect)
+{
+    isCorrect.assign(grouped.DetectedBoxes.size(), 0);
+    cv::parallel_for_(cv::Range(0, grouped.ImagesCount), [&](const cv::Range &range)
+    {
+        BoxGrid grid;
+        std::vector<unsigned char> isMatched;
+        std::vector<int> order;
+        for (int image = range.start; image < range.end; image++)
+        {
+            int actualBegin = grouped.ActualOffsets[image];
+            int actualCount = grouped.ActualOffsets[image + 1] - actualBegin;
+            int detectedBegin = grouped.DetectedOffsets[image];
+            int detectedEnd = grouped.DetectedOffsets[image + 1];
+            if (actualCount == 0 || detectedBegin == detectedEnd)
+            {
+                continue;
+            }
+            grid.build(&grouped.ActualBoxes[actualBegin], actualCount);
+
+            if (mode == MATCH_HALF_ACTUAL_AREA)
+            {
+                for (int di = detectedBegin; di < detectedEnd; di++)
+                {
+                    isCorrect[di] = grid.coversHalfOfAny(grouped.DetectedBoxes[di]);
+                }
+                continue;
+            }
+
+            order.resize(detectedEnd - detectedBegin);
+            for (int i = 0; i < order.size(); i++)
+            {
+                order[i] = detectedBegin + i;
+            }
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+            {
+                return grouped.DetectedScores[a] > grouped.DetectedScores[b];
+            });
+            isMatched.assign(actualCount, 0);
+            for (int i = 0; i < order.size(); i++)
+            {
+                int match = grid.findBestIou(grouped.DetectedBoxes[order[i]], isMatched, MIN_MATCH_IOU);
+                if (match >= 0)
+                {
+                    isMatched[match] = 1;
+                    isCorrect[order[i]] = 1;
+                }
+            }
+        }
+    });
+}
+
+EvaluationResult evaluateDetections(
+    const std::vector<ImageAnnotation> &actual,
+    const std::vector<ImageAnnotation> &detected,
+    MatchMode mode)
+{
+    GroupedAnnotations grouped;
+    groupAnnotationsByImage(actual, detected, grouped);
+    std::vector<unsigned char> isCorrect;
+    matchDetections(grouped, mode, isCorrect);
+    return evaluateDetections(grouped, isCorrect);
+}
+
+EvaluationResult evaluateDetections(const GroupedAnnotations &grouped, const std::vector<unsigned char> &isCorrect)
+{
+    EvaluationResult result;
+    // Detected pedestrians who match the correct pedestrians
+    result.TruePositives = std::count(isCorrect.begin(), isCorrect.end(), 1);
+    // Detected pedestrians who don't match any correct pedestrian
+    result.FalsePositives = isCorrect.size() - result.TruePositives;
+    result.ActualCount = grouped.ActualBoxes.size();
+    result.Recall = static_cast<double>(result.TruePositives) / result.ActualCount;
+    result.Precision = static_cast<double>(result.TruePositives) / (result.TruePositives + result.FalsePositives);
+    return result;
+}
+
+void printEvaluationResult(const EvaluationResult &result)
+{
+    std::cout << "Recall   : " << result.Recall << std::endl;
+    std::cout << "Precision: " << result.Precision << std::endl;
+}
+
+PrecisionRecallCurve computePrecisionRecallCurve(const GroupedAnnotations &grouped, const std::vector<unsigned char> &isCorrect)
+{
+    std::vector<int> order(isCorrect.size());
+    for (int i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        return grouped.DetectedScores[a] > grouped.DetectedScores[b];
+    });
+
+    PrecisionRecallCurve curve;
+    curve.AveragePrecision = 0;
+    int64_t truePositives = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        truePositives += isCorrect[order[i]];
+        float score = grouped.DetectedScores[order[i]];
+        // Equal scores can't be separated by a threshold
+        if (i + 1 < order.size() && grouped.DetectedScores[order[i + 1]] == score)
+        {
+            continue;
+        }
+
+        PrecisionRecallPoint point;
+        // The classifier keeps scores above the threshold, so this one keeps the score itself
+        point.Threshold = std::nextafter(score, -std::numeric_limits<float>::infinity());
+        point.Recall = static_cast<double>(truePositives) / grouped.ActualBoxes.size();
+        point.Precision = static_cast<double>(truePositives) / (i + 1);
+        curve.Points.push_back(point);
+    }
+
+    // Area under the curve with precision made monotonic from the right
+    double maxPrecision = 0;
+    for (size_t i = curve.Points.size(); i-- > 0;)
+    {
+        maxPrecision = std::max(maxPrecision, curve.Points[i].Precision);
+        double previousRecall = i > 0 ? curve.Points[i - 1].Recall : 0;
+        curve.AveragePrecision += (curve.Points[i].Recall - previousRecall) * maxPrecision;
+    }
+
+    return curve;
+}
+
+void printPrecisionRecallCurve(const PrecisionRecallCurve &curve, const std::vector<double> &targetPrecisions)
+{
+    std::cout << "AP       : " << curve.AveragePrecision << std::endl;
+    for (size_t t = 0; t < targetPrecisions.size(); t++)
+    {
+        const PrecisionRecallPoint *best = nullptr;
+        for (size_t i = 0; i < curve.Points.size(); i++)
+        {
+            if (curve.Points[i].Precision >= targetPrecisions[t])
+            {
+                best = &curve.Points[i];
+            }
+        }
+
+        std::cout << "Precision " << targetPrecisions[t] << ": ";
+        if (best == nullptr)
+        {
+            std::cout << "not reached" << std::endl;
+            continue;
+        }
+        // Enough digits for the threshold to parse back to the same float
+        std::cout << "threshold " << std::setprecision(std::numeric_limits<float>::max_digits10) << best->Threshold
+                  << std::setprecision(6) << ", recall " << best->Recall << std::endl;
+    }
+}
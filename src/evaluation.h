@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/types.hpp>
+#include "annotations.h"
+
+enum MatchMode
+{
+    MATCH_HALF_ACTUAL_AREA, // Detection covers at least half of any actual box on its image
+    MATCH_IOU               // Detections taken by descending score match one free actual box each with IoU >= 0.5
+};
+
+struct EvaluationResult
+{
+    int64_t TruePositives;
+    int64_t FalsePositives;
+    int64_t ActualCount;
+    double Recall;
+    double Precision;
+};
+
+// Boxes of both annotation sets grouped by interned image id. Boxes of
+// image i are in [Offsets[i], Offsets[i + 1]) of the box arrays.
+struct GroupedAnnotations
+{
+    int ImagesCount;
+    std::vector<int> ActualOffsets;
+    std::vector<cv::Rect> ActualBoxes;
+    std::vector<int> DetectedOffsets;
+    std::vector<cv::Rect> DetectedBoxes;
+    std::vector<float> DetectedScores;
+};
+
+struct PrecisionRecallPoint
+{
+    float Threshold; // Detections scored above it are kept, the same as -t of the test command
+    double Recall;
+    double Precision;
+};
+
+// Points from the highest threshold to the lowest one
+struct PrecisionRecallCurve
+{
+    std::vector<PrecisionRecallPoint> Points;
+    double AveragePrecision;
+};
+
+void groupAnnotationsByImage(
+    const std::vector<ImageAnnotation> &actual,
+    const std::vector<ImageAnnotation> &detected,
+    GroupedAnnotations &result);
+
+// Marks every detected box that matches an actual one. Images are matched
+// in parallel, the result doesn't depend on thread count.
+void matchDetections(const GroupedAnnotations &grouped, MatchMode mode, std::vector<unsigned char> &isCorrect);
+
+EvaluationResult evaluateDetections(
+    const std::vector<ImageAnnotation> &actual,
+    const std::vector<ImageAnnotation> &detected,
+    MatchMode mode);
+
+// Counts of an existing matching pass
+EvaluationResult evaluateDetections(const GroupedAnnotations &grouped, const std::vector<unsigned char> &isCorrect);
+
+void printEvaluationResult(const EvaluationResult &result);
+
+// Sorts detections by score once and sweeps them from the most confident one
+PrecisionRecallCurve computePrecisionRecallCurve(const GroupedAnnotations &grouped, const std::vector<unsigned char> &isCorrect);
+
+// Prints AP and the lowest threshold reaching every target precision
+void printPrecisionRecallCurve(const PrecisionRecallCurve &curve, const std::vector<double> &targetPrecisions);
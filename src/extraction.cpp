@@ -0,0 +1,231 @@
+#include "extraction.h"
+#include "imageUtils.h"
+#include "arenaAllocator.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static uint64_t mixBits(uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+BackgroundSamplingOptions readBackgroundSamplingOptions(const cv::FileStorage &params)
+{
+    BackgroundSamplingOptions options;
+    options.MaxPerImage = params["backgroundPerImage"];
+    options.MaxRatio = params["backgroundRatio"];
+    options.Seed = params["sampleRngSeed"];
+    return options;
+}
+
+BackgroundSampler::BackgroundSampler(const BackgroundSamplingOptions &options, int64_t peopleCount)
+    : options(options),
+      capacity(0),
+      maxKey(std::numeric_limits<uint64_t>::max())
+{
+    if (options.MaxRatio > 0)
+    {
+        capacity = static_cast<size_t>(std::ceil(options.MaxRatio * peopleCount));
+    }
+}
+
+void BackgroundSampler::sampleImage(int imageIndex, std::vector<cv::Rect> &boxes, std::vector<uint64_t> &keys) const
+{
+    uint64_t imageSeed = mixBits(static_cast<uint64_t>(options.Seed) ^ mixBits(imageIndex));
+    keys.resize(boxes.size());
+    for (int i = 0; i < boxes.size(); i++)
+    {
+        // Zero is reserved for people
+        keys[i] = std::max<uint64_t>(mixBits(imageSeed ^ i), 1);
+    }
+
+    std::vector<int> kept;
+    if (options.MaxPerImage > 0 && boxes.size() > options.MaxPerImage)
+    {
+        cv::RNG rng(imageSeed);
+        for (int i = 0; i < boxes.size(); i++)
+        {
+            if (i < options.MaxPerImage)
+            {
+                kept.push_back(i);
+                continue;
+            }
+            int slot = rng.uniform(0, i + 1);
+            if (slot < options.MaxPerImage)
+            {
+                kept[slot] = i;
+            }
+        }
+        std::sort(kept.begin(), kept.end());
+    }
+    else
+    {
+        for (int i = 0; i < boxes.size(); i++)
+        {
+            kept.push_back(i);
+        }
+    }
+
+    // Keys above the largest one in a full global sample will never get in
+    uint64_t limit = maxKey.load();
+    int keptCount = 0;
+    for (int k = 0; k < kept.size(); k++)
+    {
+        if (keys[kept[k]] <= limit)
+        {
+            boxes[keptCount] = boxes[kept[k]];
+            keys[keptCount] = keys[kept[k]];
+            keptCount++;
+        }
+    }
+    boxes.resize(keptCount);
+    keys.resize(keptCount);
+}
+
+void BackgroundSampler::add(const std::vector<uint64_t> &keys)
+{
+    if (!isGloballyLimited())
+    {
+        return;
+    }
+
+    for (int i = 0; i < keys.size(); i++)
+    {
+        if (keys[i] == 0)
+        {
+            continue;
+        }
+        if (smallestKeys.size() < capacity)
+        {
+            smallestKeys.push(keys[i]);
+        }
+        else if (keys[i] < smallestKeys.top())
+        {
+            smallestKeys.pop();
+            smallestKeys.push(keys[i]);
+        }
+    }
+    if (smallestKeys.size() >= capacity)
+    {
+        maxKey = capacity > 0 ? smallestKeys.top() : 0;
+    }
+}
+
+bool BackgroundSampler::isGloballyLimited() const
+{
+    return options.MaxRatio > 0;
+}
+
+uint64_t BackgroundSampler::getMaxKey() const
+{
+    return maxKey.load();
+}
+
+void BackgroundSampler::selectRows(const ImageSamples &samples, ImageSamples &result) const
+{
+    uint64_t limit = maxKey.load();
+    std::vector<int> rows;
+    for (int i = 0; i < samples.Keys.size(); i++)
+    {
+        if (samples.Keys[i] <= limit)
+        {
+            rows.push_back(i);
+        }
+    }
+
+    result.BackgroundProposals = samples.BackgroundProposals;
+    if (rows.size() == samples.Keys.size())
+    {
+        result.Descriptors = samples.Descriptors;
+        result.Labels = samples.Labels;
+        result.Keys = samples.Keys;
+        return;
+    }
+
+    result.Descriptors.create(static_cast<int>(rows.size()), samples.Descriptors.cols, CV_32FC1);
+    result.Labels.clear();
+    result.Keys.clear();
+    for (int i = 0; i < rows.size(); i++)
+    {
+        samples.Descriptors.row(rows[i]).copyTo(result.Descriptors.row(i));
+        result.Labels.push_back(samples.Labels[rows[i]]);
+        result.Keys.push_back(samples.Keys[rows[i]]);
+    }
+}
+
+void groupPeopleBoxes(
+    const std::vector<ImageAnnotation> &annotations,
+    std::unordered_map<std::string, std::vector<cv::Rect>> &result)
+{
+    for (int i = 0; i < annotations.size(); i++)
+    {
+        result[annotations[i].FileName].push_back(annotations[i].Bbox);
+    }
+}
+
+void selectTrainingBoxes(
+    const std::vector<cv::Rect> &proposals,
+    const std::vector<cv::Rect> &peopleBoxes,
+    const BackgroundSampler &sampler,
+    int imageIndex,
+    std::vector<cv::Rect> &boxes,
+    ImageSamples &result)
+{
+    std::vector<cv::Rect> backgroundBoxes;
+    for (int i = 0; i < proposals.size(); i++)
+    {
+        if (!overlapsAny(proposals[i], peopleBoxes))
+        {
+            backgroundBoxes.push_back(proposals[i]);
+        }
+    }
+    result.BackgroundProposals = backgroundBoxes.size();
+    std::vector<uint64_t> backgroundKeys;
+    sampler.sampleImage(imageIndex, backgroundBoxes, backgroundKeys);
+
+    boxes.clear();
+    result.Labels.clear();
+    result.Keys.clear();
+    for (int i = 0; i < peopleBoxes.size(); i++)
+    {
+        boxes.push_back(peopleBoxes[i]);
+        result.Labels.push_back(Label::LABEL_PERSON);
+        result.Keys.push_back(0);
+    }
+    for (int i = 0; i < backgroundBoxes.size(); i++)
+    {
+        boxes.push_back(backgroundBoxes[i]);
+        result.Labels.push_back(Label::LABEL_BACKGROUND);
+        result.Keys.push_back(backgroundKeys[i]);
+    }
+}
+
+void extractImageSamples(
+    const cv::HOGDescriptor &hog,
+    const cv::Mat &image,
+    const std::vector<cv::Rect> &proposals,
+    const std::vector<cv::Rect> &peopleBoxes,
+    const BackgroundSampler &sampler,
+    int imageIndex,
+    ImageSamples &result)
+{
+    std::vector<cv::Rect> imageBoxes;
+    selectTrainingBoxes(proposals, peopleBoxes, sampler, imageIndex, imageBoxes, result);
+
+    result.Descriptors.create(static_cast<int>(imageBoxes.size()), static_cast<int>(hog.getDescriptorSize()), CV_32FC1);
+    ArenaScope arenaScope;
+    std::vector<float> descriptors;
+    for (int i = 0; i < imageBoxes.size(); i++)
+    {
+        cv::Mat sliceImage = image(imageBoxes[i]);
+        cv::Mat windowImage;
+        imresizeContain(sliceImage, windowImage, hog.winSize);
+
+        hog.compute(windowImage, descriptors);
+        cv::Mat(1, static_cast<int>(descriptors.size()), CV_32FC1, descriptors.data()).copyTo(result.Descriptors.row(i));
+    }
+}
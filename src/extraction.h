@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+#include "annotations.h"
+#include "detection.h"
+
+// Training windows of a single image, one descriptor per row
+struct ImageSamples
+{
+    cv::Mat Descriptors;
+    std::vector<Label> Labels;
+    std::vector<uint64_t> Keys; // Sampling keys of background rows, 0 for people
+    int BackgroundProposals;    // Background boxes found before sampling
+};
+
+// Limits of background windows, see params.yml. Zero disables a limit.
+struct BackgroundSamplingOptions
+{
+    int MaxPerImage;
+    double MaxRatio; // Background windows per person window over the whole train sample
+    int Seed;
+};
+
+BackgroundSamplingOptions readBackgroundSamplingOptions(const cv::FileStorage &params);
+
+// Picks background boxes before they are resized and HOG'd. Every box gets a
+// random key derived from the seed, the image index and the box index, and the
+// global sample is the boxes with the smallest keys, so the result doesn't
+// depend on the order images are processed in.
+class BackgroundSampler
+{
+public:
+    BackgroundSampler(const BackgroundSamplingOptions &options, int64_t peopleCount);
+
+    // Reservoir of at most MaxPerImage boxes followed by dropping boxes that can't
+    // get into the global sample anymore. Kept boxes stay in their original order.
+    void sampleImage(int imageIndex, std::vector<cv::Rect> &boxes, std::vector<uint64_t> &keys) const;
+
+    // Adds keys of extracted background windows, called in image order
+    void add(const std::vector<uint64_t> &keys);
+
+    // Whether windows have to wait for the final sample before training
+    bool isGloballyLimited() const;
+    // Largest key of the global sample, background windows above it are dropped
+    uint64_t getMaxKey() const;
+
+    // Copies people rows and background rows whose keys are in the sample
+    void selectRows(const ImageSamples &samples, ImageSamples &result) const;
+
+private:
+    BackgroundSamplingOptions options;
+    size_t capacity;
+    std::priority_queue<uint64_t> smallestKeys;
+    std::atomic<uint64_t> maxKey;
+};
+
+// People boxes of every annotated image, built in one pass over the annotations
+void groupPeopleBoxes(
+    const std::vector<ImageAnnotation> &annotations,
+    std::unordered_map<std::string, std::vector<cv::Rect>> &result);
+
+// Boxes of people followed by sampled background proposals not overlapping any of
+// them. Fills labels, keys and proposals count of result, but not descriptors.
+void selectTrainingBoxes(
+    const std::vector<cv::Rect> &proposals,
+    const std::vector<cv::Rect> &peopleBoxes,
+    const BackgroundSampler &sampler,
+    int imageIndex,
+    std::vector<cv::Rect> &boxes,
+    ImageSamples &result);
+
+// Descriptors of the windows of selectTrainingBoxes.
+// Only depends on its arguments, so images may be processed in any order.
+void extractImageSamples(
+    const cv::HOGDescriptor &hog,
+    const cv::Mat &image,
+    const std::vector<cv::Rect> &proposals,
+    const std::vector<cv::Rect> &peopleBoxes,
+    const BackgroundSampler &sampler,
+    int imageIndex,
+    ImageSamples &result);
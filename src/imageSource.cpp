@@ -0,0 +1,336 @@
+#include "imageSource.h"
+#include "ioUtils.h"
+#include "manifest.h"
+#include <opencv2/core/utils/filesystem.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Archive layout: header, index entries sorted by name, name bytes, image bytes
+static const char IMAGE_ARCHIVE_MAGIC[8] = {'P', 'P', 'L', 'I', 'M', 'A', 'G', 'E'};
+static const uint32_t IMAGE_ARCHIVE_VERSION = 1;
+
+struct ImageArchiveHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t ImagesCount;
+    uint64_t NamesBytes;
+};
+
+struct ImageArchiveIndexEntry
+{
+    uint64_t DataOffset;
+    uint64_t DataLength;
+    uint32_t NameOffset;
+    uint32_t NameLength;
+};
+
+int ImageSource::open(const std::string location)
+{
+    this->location = location;
+    archive.close();
+    imageFiles.clear();
+    entries.clear();
+
+    if (cv::utils::fs::isDirectory(location))
+    {
+        imageFiles = getImagesSorted(location);
+        return 0;
+    }
+    if (isManifestFile(location))
+    {
+        return openManifest(location);
+    }
+    return openArchive(location);
+}
+
+bool ImageSource::isArchive() const
+{
+    return archive.data() != nullptr;
+}
+
+const std::vector<std::string> &ImageSource::getImageFiles() const
+{
+    return imageFiles;
+}
+
+std::string ImageSource::getImagePath(const std::string imageFile) const
+{
+    if (isArchive())
+    {
+        return location + ":" + imageFile;
+    }
+    return combinePath(location, imageFile);
+}
+
+int ImageSource::readImage(const std::string imageFile, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color) const
+{
+    if (!isArchive())
+    {
+        return ::readImage(combinePath(location, imageFile), policy, withColor, grayscale, color);
+    }
+
+    cv::Mat encoded = getEncoded(imageFile);
+    if (encoded.empty())
+    {
+        return 1;
+    }
+    return decodeImage(encoded, policy, withColor, grayscale, color);
+}
+
+int ImageSource::readGrayscale(const std::string imageFile, cv::Mat &grayscale) const
+{
+    cv::Mat color;
+    return readImage(imageFile, DECODE_GRAYSCALE, false, grayscale, color);
+}
+
+cv::Mat ImageSource::getEncoded(const std::string imageFile) const
+{
+    int index = findImage(imageFile);
+    if (!isArchive() || index < 0)
+    {
+        return cv::Mat();
+    }
+
+    const ArchiveEntry &entry = entries[index];
+    void *data = const_cast<char *>(archive.data() + entry.Offset);
+    return cv::Mat(1, static_cast<int>(entry.Length), CV_8UC1, data);
+}
+
+// Reads a whole file asking the kernel to read it ahead in one go
+static int readFileWithHints(const std::string path, cv::Mat &bytes)
+{
+#ifdef _WIN32
+    std::vector<unsigned char> buffer;
+    if (readFileBytes(path, buffer) != 0)
+    {
+        return 1;
+    }
+    bytes = cv::Mat(buffer, true).reshape(1, 1);
+    return 0;
+#else
+    int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+    {
+        return 1;
+    }
+
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0 || fileStat.st_size > INT32_MAX)
+    {
+        ::close(fileDescriptor);
+        return 1;
+    }
+    posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_WILLNEED);
+
+    bytes.create(1, static_cast<int>(fileStat.st_size), CV_8UC1);
+    size_t done = 0;
+    while (done < bytes.total())
+    {
+        ssize_t count = ::read(fileDescriptor, bytes.data + done, bytes.total() - done);
+        if (count <= 0)
+        {
+            ::close(fileDescriptor);
+            bytes.release();
+            return 1;
+        }
+        done += count;
+    }
+    ::close(fileDescriptor);
+    return 0;
+#endif
+}
+
+int ImageSource::readEncoded(const std::string imageFile, cv::Mat &encoded) const
+{
+    if (!isArchive())
+    {
+        return readFileWithHints(combinePath(location, imageFile), encoded);
+    }
+
+    int index = findImage(imageFile);
+    if (index < 0)
+    {
+        encoded.release();
+        return 1;
+    }
+    archive.prefetch(entries[index].Offset, entries[index].Length);
+    encoded = getEncoded(imageFile);
+    return 0;
+}
+
+int ImageSource::openArchive(const std::string archiveFile)
+{
+    if (!archive.open(archiveFile))
+    {
+        std::cout << "Can't open images directory or archive " << archiveFile << std::endl;
+        return 1;
+    }
+
+    const char *data = archive.data();
+    size_t size = archive.size();
+    ImageArchiveHeader header;
+    if (size < sizeof(header))
+    {
+        std::cout << "Not an images archive " << archiveFile << std::endl;
+        archive.close();
+        return 1;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.Magic, IMAGE_ARCHIVE_MAGIC, sizeof(header.Magic)) != 0 || header.Version != IMAGE_ARCHIVE_VERSION)
+    {
+        std::cout << "Not an images archive " << archiveFile << std::endl;
+        archive.close();
+        return 1;
+    }
+
+    size_t indexBytes = header.ImagesCount * sizeof(ImageArchiveIndexEntry);
+    size_t namesOffset = sizeof(header) + indexBytes;
+    if (namesOffset + header.NamesBytes > size)
+    {
+        std::cout << "Truncated images archive " << archiveFile << std::endl;
+        archive.close();
+        return 1;
+    }
+
+    const char *names = data + namesOffset;
+    imageFiles.reserve(header.ImagesCount);
+    entries.reserve(header.ImagesCount);
+    for (uint32_t i = 0; i < header.ImagesCount; i++)
+    {
+        ImageArchiveIndexEntry indexEntry;
+        std::memcpy(&indexEntry, data + sizeof(header) + i * sizeof(indexEntry), sizeof(indexEntry));
+        bool isValid = static_cast<uint64_t>(indexEntry.NameOffset) + indexEntry.NameLength <= header.NamesBytes &&
+                       indexEntry.DataOffset <= size && indexEntry.DataLength <= size - indexEntry.DataOffset &&
+                       indexEntry.DataLength <= INT32_MAX;
+        if (!isValid)
+        {
+            std::cout << "Corrupted entry " << i << " in images archive " << archiveFile << std::endl;
+            archive.close();
+            imageFiles.clear();
+            entries.clear();
+            return 1;
+        }
+
+        imageFiles.push_back(std::string(names + indexEntry.NameOffset, indexEntry.NameLength));
+        ArchiveEntry entry;
+        entry.Offset = indexEntry.DataOffset;
+        entry.Length = indexEntry.DataLength;
+        entries.push_back(entry);
+    }
+
+    if (!std::is_sorted(imageFiles.begin(), imageFiles.end()))
+    {
+        std::cout << "Unsorted index in images archive " << archiveFile << std::endl;
+        archive.close();
+        imageFiles.clear();
+        entries.clear();
+        return 1;
+    }
+
+    return 0;
+}
+
+int ImageSource::openManifest(const std::string manifestFile)
+{
+    DatasetManifest manifest;
+    if (readManifest(manifestFile, manifest) != 0)
+    {
+        return 1;
+    }
+
+    location = manifest.ImagesDir;
+    if (!isManifestUpToDate(manifest))
+    {
+        std::cout << "Manifest " << manifestFile << " is out of date, listing " << location << std::endl;
+        imageFiles = getImagesSorted(location);
+        return 0;
+    }
+
+    imageFiles.reserve(manifest.Entries.size());
+    for (int i = 0; i < manifest.Entries.size(); i++)
+    {
+        imageFiles.push_back(std::move(manifest.Entries[i].FileName));
+    }
+    return 0;
+}
+
+int ImageSource::findImage(const std::string imageFile) const
+{
+    auto found = std::lower_bound(imageFiles.begin(), imageFiles.end(), imageFile);
+    if (found == imageFiles.end() || *found != imageFile)
+    {
+        return -1;
+    }
+    return found - imageFiles.begin();
+}
+
+int packImages(const std::string imagesDir, const std::string archiveFile)
+{
+    std::vector<std::string> images = getImagesSorted(imagesDir);
+
+    std::ofstream f;
+    f.open(archiveFile, std::ios::binary);
+    if (!f.is_open())
+    {
+        std::cout << "Can't open file to save images archive " << archiveFile << std::endl;
+        return 1;
+    }
+
+    std::vector<ImageArchiveIndexEntry> index(images.size());
+    std::string names;
+    for (int i = 0; i < images.size(); i++)
+    {
+        index[i].NameOffset = names.size();
+        index[i].NameLength = images[i].size();
+        names += images[i];
+    }
+
+    ImageArchiveHeader header;
+    std::memcpy(header.Magic, IMAGE_ARCHIVE_MAGIC, sizeof(header.Magic));
+    header.Version = IMAGE_ARCHIVE_VERSION;
+    header.ImagesCount = images.size();
+    header.NamesBytes = names.size();
+
+    // The index is written once more after data offsets are known
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(ImageArchiveIndexEntry));
+    f.write(names.data(), names.size());
+
+    std::vector<unsigned char> bytes;
+    for (int i = 0; i < images.size(); i++)
+    {
+        std::string imagePath = combinePath(imagesDir, images[i]);
+        if (readFileBytes(imagePath, bytes) != 0)
+        {
+            std::cout << "Cannot open image " << imagePath << std::endl;
+            return 1;
+        }
+
+        index[i].DataOffset = static_cast<uint64_t>(f.tellp());
+        index[i].DataLength = bytes.size();
+        f.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+
+    f.seekp(sizeof(header));
+    f.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(ImageArchiveIndexEntry));
+    f.close();
+    if (f.fail())
+    {
+        std::cout << "Can't write images archive " << archiveFile << std::endl;
+        return 1;
+    }
+
+    std::cout << "Packed " << images.size() << " images into " << archiveFile << std::endl;
+    return 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "imageUtils.h"
+#include "mappedFile.h"
+
+// Images of a dataset: the JPEG files of a directory, listed directly or by
+// a manifest, or the entries of an archive made by the pack command. Archives
+// are memory mapped and decoded in place, so reading an image needs no system calls.
+class ImageSource
+{
+public:
+    int open(const std::string location);
+
+    bool isArchive() const;
+
+    // Sorted by name like getImagesSorted
+    const std::vector<std::string> &getImageFiles() const;
+
+    // Path of the image for messages
+    std::string getImagePath(const std::string imageFile) const;
+
+    int readImage(const std::string imageFile, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color) const;
+    int readGrayscale(const std::string imageFile, cv::Mat &grayscale) const;
+
+    // Encoded bytes of an archive entry without copying, empty for directories
+    cv::Mat getEncoded(const std::string imageFile) const;
+
+    // Encoded bytes of any image, made resident in memory for decoding
+    int readEncoded(const std::string imageFile, cv::Mat &encoded) const;
+
+private:
+    struct ArchiveEntry
+    {
+        uint64_t Offset;
+        uint64_t Length;
+    };
+
+    int openArchive(const std::string archiveFile);
+    int openManifest(const std::string manifestFile);
+    int findImage(const std::string imageFile) const;
+
+    std::string location;
+    MappedFile archive;
+    std::vector<std::string> imageFiles;
+    std::vector<ArchiveEntry> entries;
+};
+
+// Concatenates every JPEG of the directory into a single archive with an index
+int packImages(const std::string imagesDir, const std::string archiveFile);
@@ -1,7 +1,51 @@
+#include "imageUtils.h"
+#include "arenaAllocator.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <vector>
 
+// Shared by file and in-memory decoding, decode takes cv::ImreadModes flags
+template <typename Decode>
+static int loadImage(Decode decode, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color)
+{
+    if (withColor && policy == DECODE_COLOR)
+    {
+        color = decode(cv::ImreadModes::IMREAD_COLOR);
+        if (color.empty())
+        {
+            return 1;
+        }
+        cv::cvtColor(color, grayscale, cv::COLOR_BGR2GRAY);
+        return 0;
+    }
+
+    grayscale = decode(cv::ImreadModes::IMREAD_GRAYSCALE);
+    if (grayscale.empty())
+    {
+        return 1;
+    }
+    if (withColor)
+    {
+        cv::cvtColor(grayscale, color, cv::COLOR_GRAY2BGR);
+    }
+    return 0;
+}
+
+int readImage(const std::string path, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color)
+{
+    return loadImage([&](int flags)
+                     { return cv::imread(path, flags); },
+                     policy, withColor, grayscale, color);
+}
+
+int decodeImage(const cv::Mat &encoded, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color)
+{
+    return loadImage([&](int flags)
+                     { return cv::imdecode(encoded, flags); },
+                     policy, withColor, grayscale, color);
+}
+
 void imresizeContain(const cv::Mat &source, cv::Mat &dest, const cv::Size destinationSize)
 {
     cv::Size sourceSize = source.size();
@@ -65,23 +109,33 @@ bool overlapsAny(const cv::Rect &rect, const std::vector<cv::Rect> &rects)
     return false;
 }
 
-std::vector<cv::Rect> findBoxesOnBlackBackground(cv::Mat grayscaleImage)
+void findForegroundMask(const cv::Mat &grayscaleImage, cv::Mat &mask)
 {
-    cv::Mat grayscale = grayscaleImage.clone();
-    cv::blur(grayscale, grayscale, cv::Size(13, 13));
+    cv::Mat grayscale;
+    cv::blur(grayscaleImage, grayscale, cv::Size(PROPOSAL_BLUR_SIZE, PROPOSAL_BLUR_SIZE));
+    cv::threshold(grayscale, mask, PROPOSAL_THRESHOLD, 255, cv::THRESH_BINARY);
+}
 
-    cv::Mat binaryImage;
+std::vector<cv::Rect> findContourBoxes(const cv::Mat &mask)
+{
     std::vector<std::vector<cv::Point>> contours;
     std::vector<cv::Vec4i> hierarchy;
-
-    cv::threshold(grayscale, binaryImage, 5, 255, cv::THRESH_BINARY);
-    cv::findContours(binaryImage, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE, cv::Point(0, 0));
+    cv::findContours(mask, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE, cv::Point(0, 0));
 
     std::vector<cv::Rect> boundRect(contours.size());
     for (int i = 0; i < contours.size(); i++)
     {
         boundRect[i] = cv::boundingRect(cv::Mat(contours[i]));
     }
+    return boundRect;
+}
+
+std::vector<cv::Rect> findBoxesOnBlackBackground(cv::Mat grayscaleImage)
+{
+    // The blurred copy, the mask and the contours only live for the call
+    ArenaScope arenaScope;
+    cv::Mat binaryImage;
+    findForegroundMask(grayscaleImage, binaryImage);
 
-    return findNonOverlappingBoxes(boundRect);
+    return findNonOverlappingBoxes(findContourBoxes(binaryImage));
 }
@@ -1,8 +1,31 @@
+#pragma once
+#include <string>
 #include <vector>
 #include <opencv2/core/core.hpp>
 
+// Blur kernel and brightness level separating people from the black background
+const int PROPOSAL_BLUR_SIZE = 13;
+const int PROPOSAL_THRESHOLD = 5;
+
+enum DecodePolicy
+{
+    DECODE_GRAYSCALE, // Decode grayscale, draw on its BGR copy
+    DECODE_COLOR      // Decode color, convert to grayscale for detection
+};
+
+// Decodes the image once. The color image is only produced when withColor is set.
+int readImage(const std::string path, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color);
+// Same as readImage for a file already in memory, encoded is a single row of bytes
+int decodeImage(const cv::Mat &encoded, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color);
+
 void imresizeContain(const cv::Mat &source, cv::Mat &dest, const cv::Size destinationSize);
 
 bool overlapsAny(const cv::Rect &rect, const std::vector<cv::Rect> &rects);
 
+std::vector<cv::Rect> findNonOverlappingBoxes(const std::vector<cv::Rect> &rectangles);
+
+void findForegroundMask(const cv::Mat &grayscaleImage, cv::Mat &mask);
+
+std::vector<cv::Rect> findContourBoxes(const cv::Mat &mask);
+
 std::vector<cv::Rect> findBoxesOnBlackBackground(cv::Mat grayscaleImage);
@@ -0,0 +1,210 @@
+#include "incrementalProposals.h"
+#include "imageUtils.h"
+#include <opencv2/imgproc.hpp>
+
+static cv::Rect inflateRect(const cv::Rect &rect, int size)
+{
+    return cv::Rect(rect.x - size, rect.y - size, rect.width + 2 * size, rect.height + 2 * size);
+}
+
+static bool touchesAny(const cv::Rect &rect, const std::vector<cv::Rect> &rects)
+{
+    // Inflating by a pixel also catches diagonal neighbours of 8-connected contours
+    return overlapsAny(inflateRect(rect, 1), rects);
+}
+
+static std::vector<cv::Rect> mergeTouchingRects(std::vector<cv::Rect> rects)
+{
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (int i = 0; i < rects.size() && !merged; i++)
+        {
+            for (int j = i + 1; j < rects.size(); j++)
+            {
+                if ((inflateRect(rects[i], 1) & rects[j]).area() > 0)
+                {
+                    rects[i] |= rects[j];
+                    rects.erase(rects.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+    return rects;
+}
+
+IncrementalProposals::IncrementalProposals(int tileSize, int refreshInterval, int pixelTolerance)
+    : tileSize(tileSize),
+      refreshInterval(refreshInterval),
+      pixelTolerance(pixelTolerance),
+      framesSinceRefresh(0),
+      changedTilesCount(0)
+{
+}
+
+std::vector<cv::Rect> IncrementalProposals::update(const cv::Mat &grayscaleFrame)
+{
+    bool isRefreshDue = refreshInterval > 0 && framesSinceRefresh + 1 >= refreshInterval;
+    if (reference.empty() || grayscaleFrame.size() != reference.size() || isRefreshDue)
+    {
+        refresh(grayscaleFrame);
+        return proposals;
+    }
+    framesSinceRefresh++;
+
+    // Find tiles that changed since their pixels were last used for the mask
+    const cv::Rect frameRect(0, 0, reference.cols, reference.rows);
+    const int blurRadius = PROPOSAL_BLUR_SIZE / 2;
+    std::vector<cv::Rect> remaskRects;
+    cv::Mat difference;
+    changedTilesCount = 0;
+    for (int tileY = 0; tileY < tilesGrid.height; tileY++)
+    {
+        for (int tileX = 0; tileX < tilesGrid.width; tileX++)
+        {
+            cv::Rect tile = getTileRect(tileX, tileY);
+            cv::absdiff(grayscaleFrame(tile), reference(tile), difference);
+            double maxDifference;
+            cv::minMaxLoc(difference, nullptr, &maxDifference);
+
+            bool isChanged = maxDifference > pixelTolerance;
+            changedTiles[tileY * tilesGrid.width + tileX] = isChanged;
+            if (isChanged)
+            {
+                changedTilesCount++;
+                grayscaleFrame(tile).copyTo(reference(tile));
+                remaskRects.push_back(inflateRect(tile, blurRadius) & frameRect);
+            }
+        }
+    }
+
+    if (changedTilesCount == 0)
+    {
+        return proposals;
+    }
+
+    // Blur sees the pixels around the ROI, so the patched mask is the same as a full recompute
+    std::vector<cv::Rect> dirtyRegions;
+    cv::Mat blurred, maskPart, maskDifference;
+    for (int i = 0; i < remaskRects.size(); i++)
+    {
+        cv::Rect rect = remaskRects[i];
+        cv::blur(reference(rect), blurred, cv::Size(PROPOSAL_BLUR_SIZE, PROPOSAL_BLUR_SIZE));
+        cv::threshold(blurred, maskPart, PROPOSAL_THRESHOLD, 255, cv::THRESH_BINARY);
+        cv::compare(maskPart, mask(rect), maskDifference, cv::CMP_NE);
+        if (cv::countNonZero(maskDifference) == 0)
+        {
+            continue;
+        }
+
+        cv::Rect changedArea = cv::boundingRect(maskDifference);
+        dirtyRegions.push_back(changedArea + rect.tl());
+        maskPart.copyTo(mask(rect));
+    }
+
+    if (dirtyRegions.empty())
+    {
+        return proposals;
+    }
+
+    // Contours touching a dirty region may have grown, merged or split,
+    // so their whole area is searched again
+    std::vector<cv::Rect> regions = mergeTouchingRects(dirtyRegions);
+    std::vector<bool> absorbed(contourBoxes.size(), false);
+    bool grown = true;
+    while (grown)
+    {
+        grown = false;
+        for (int i = 0; i < contourBoxes.size(); i++)
+        {
+            if (!absorbed[i] && touchesAny(contourBoxes[i], regions))
+            {
+                absorbed[i] = true;
+                regions.push_back(contourBoxes[i]);
+                grown = true;
+            }
+        }
+        if (grown)
+        {
+            regions = mergeTouchingRects(regions);
+        }
+    }
+
+    std::vector<cv::Rect> updatedBoxes;
+    for (int i = 0; i < contourBoxes.size(); i++)
+    {
+        if (!absorbed[i])
+        {
+            updatedBoxes.push_back(contourBoxes[i]);
+        }
+    }
+    for (int i = 0; i < regions.size(); i++)
+    {
+        cv::Rect region = regions[i] & frameRect;
+        std::vector<cv::Rect> regionBoxes = findContourBoxes(mask(region));
+        for (int j = 0; j < regionBoxes.size(); j++)
+        {
+            updatedBoxes.push_back(regionBoxes[j] + region.tl());
+        }
+    }
+
+    contourBoxes = updatedBoxes;
+    proposals = findNonOverlappingBoxes(contourBoxes);
+    return proposals;
+}
+
+bool IncrementalProposals::isUnchanged(const cv::Rect &box) const
+{
+    if (box.area() <= 0)
+    {
+        return true;
+    }
+
+    int lastTileX = std::min((box.x + box.width - 1) / tileSize, tilesGrid.width - 1);
+    int lastTileY = std::min((box.y + box.height - 1) / tileSize, tilesGrid.height - 1);
+    for (int tileY = std::max(box.y / tileSize, 0); tileY <= lastTileY; tileY++)
+    {
+        for (int tileX = std::max(box.x / tileSize, 0); tileX <= lastTileX; tileX++)
+        {
+            if (changedTiles[tileY * tilesGrid.width + tileX])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int IncrementalProposals::getChangedTilesCount() const
+{
+    return changedTilesCount;
+}
+
+int IncrementalProposals::getTilesCount() const
+{
+    return tilesGrid.area();
+}
+
+void IncrementalProposals::refresh(const cv::Mat &grayscaleFrame)
+{
+    reference = grayscaleFrame.clone();
+    findForegroundMask(reference, mask);
+    contourBoxes = findContourBoxes(mask);
+    proposals = findNonOverlappingBoxes(contourBoxes);
+
+    tilesGrid = cv::Size(
+        (reference.cols + tileSize - 1) / tileSize,
+        (reference.rows + tileSize - 1) / tileSize);
+    changedTiles.assign(tilesGrid.area(), true);
+    changedTilesCount = tilesGrid.area();
+    framesSinceRefresh = 0;
+}
+
+cv::Rect IncrementalProposals::getTileRect(int tileX, int tileY) const
+{
+    cv::Rect tile(tileX * tileSize, tileY * tileSize, tileSize, tileSize);
+    return tile & cv::Rect(0, 0, reference.cols, reference.rows);
+}
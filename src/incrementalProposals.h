@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Keeps the foreground mask and proposals of a video between frames and
+// recomputes them only inside the tiles whose pixels changed.
+class IncrementalProposals
+{
+public:
+    // pixelTolerance is the largest per-pixel difference still treated as no change.
+    // Everything is recomputed from scratch every refreshInterval frames.
+    IncrementalProposals(int tileSize, int refreshInterval, int pixelTolerance);
+
+    std::vector<cv::Rect> update(const cv::Mat &grayscaleFrame);
+
+    // True if no pixel under the box changed since the previous frame
+    bool isUnchanged(const cv::Rect &box) const;
+
+    int getChangedTilesCount() const;
+    int getTilesCount() const;
+
+private:
+    void refresh(const cv::Mat &grayscaleFrame);
+    cv::Rect getTileRect(int tileX, int tileY) const;
+
+    int tileSize;
+    int refreshInterval;
+    int pixelTolerance;
+    int framesSinceRefresh;
+
+    cv::Size tilesGrid;
+    std::vector<bool> changedTiles; // Tiles whose pixels changed in the last frame
+    int changedTilesCount;
+
+    cv::Mat reference; // Pixels the current mask was computed from
+    cv::Mat mask;
+    std::vector<cv::Rect> contourBoxes;
+    std::vector<cv::Rect> proposals;
+};
@@ -1,6 +1,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <fstream>
 #include <opencv2/core/core.hpp>
 
 std::string combinePath(std::string a, std::string b)
@@ -26,10 +27,26 @@ std::string fileNameWithExtension(std::string path)
     return path.substr(slash + 1);
 }
 
+int readFileBytes(const std::string path, std::vector<unsigned char> &bytes)
+{
+    std::ifstream f;
+    f.open(path, std::ios::binary | std::ios::ate);
+    if (!f.is_open())
+    {
+        return 1;
+    }
+
+    std::streamoff size = f.tellg();
+    f.seekg(0);
+    bytes.resize(static_cast<size_t>(size));
+    f.read(reinterpret_cast<char *>(bytes.data()), size);
+    return f.gcount() == size ? 0 : 1;
+}
+
 std::vector<std::string> getImagesSorted(const std::string imagesDirectory)
 {
     std::vector<std::string> files;
-    cv::glob(imagesDirectory + "*.jpg", files, false);
+    cv::glob(combinePath(imagesDirectory, "*.jpg"), files, false);
     std::vector<std::string> result;
     for (auto b = files.begin(), e = files.end(); b != e; b++)
     {
@@ -41,29 +58,3 @@ std::vector<std::string> getImagesSorted(const std::string imagesDirectory)
 
     return result;
 }
-
-std::vector<std::string> getTrainOrValidationSample(
-    const std::vector<std::string> &fullSet,
-    cv::RNG rng,
-    float splitRate,
-    bool isTrainSample)
-{
-    int trainSetSize = fullSet.size() * splitRate;
-    std::set<int> trainIndices;
-    while (trainIndices.size() < trainSetSize)
-    {
-        int index = rng.uniform(0, trainSetSize);
-        trainIndices.insert(index);
-    }
-
-    std::vector<std::string> result;
-    for (int i = 0; i < fullSet.size(); i++)
-    {
-        bool isElementFromTrainSample = trainIndices.find(i) == trainIndices.end();
-        if (isElementFromTrainSample != isTrainSample)
-        {
-            result.push_back(fullSet[i]);
-        }
-    }
-    return result;
-}
@@ -1,4 +1,7 @@
+#pragma once
 #include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
 
 std::string combinePath(std::string a, std::string b);
 
@@ -6,8 +9,4 @@ std::vector<std::string> getImagesSorted(const std::string imagesDirectory);
 
 std::string fileNameWithoutExtension(std::string path);
 
-std::vector<std::string> getTrainOrValidationSample(
-    const std::vector<std::string> &fullSet,
-    cv::RNG rng,
-    float splitRate,
-    bool isTrainSample);
+int readFileBytes(const std::string path, std::vector<unsigned char> &bytes);
@@ -3,63 +3,86 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/objdetect/objdetect.hpp>
 #include <opencv2/ml.hpp>
+#include <fstream>
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
 #include "ioUtils.h"
+#include "sampling.h"
 #include "imageUtils.h"
 #include "annotations.h"
-
-enum Label
+#include "evaluation.h"
+#include "detection.h"
+#include "videoDetection.h"
+#include "benchmarks.h"
+#include "visualization.h"
+#include "imageSource.h"
+#include "prefetcher.h"
+#include "manifest.h"
+#include "sgdTrainer.h"
+#include "extraction.h"
+#include "descriptorTransform.h"
+#include "quantization.h"
+#include "sweep.h"
+#include "proposalCache.h"
+#include "arenaAllocator.h"
+#include "memoryStats.h"
+
+// Training windows compared between int8 and float scores
+const int CALIBRATION_WINDOWS = 20000;
+
+// Stores the error of int8 scores of the trained linear model on raw descriptors
+int calibrateQuantizedScoring(const std::string modelFile, const cv::HOGDescriptor &hog, const cv::Mat &samples)
 {
-    LABEL_PERSON = 1,
-    LABEL_BACKGROUND = 2
-};
-
-int detectPeople(
-    const cv::Ptr<cv::ml::SVM> &svm,
-    const cv::HOGDescriptor &hog,
-    const cv::Mat image,
-    std::vector<cv::Rect> &locations);
-
-void createHog(const cv::FileStorage &params, cv::HOGDescriptor &hog)
-{
-    hog.winSize = cv::Size(params["windowSizeX"], params["windowSizeY"]);
-    hog.histogramNormType = cv::HOGDescriptor::HistogramNormType::L2Hys;
-
-    hog.blockSize.width = params["blockSizeX"];
-    hog.blockSize.height = params["blockSizeY"];
-
-    hog.blockStride.width = params["blockStrideX"];
-    hog.blockStride.height = params["blockStrideY"];
-
-    hog.cellSize.width = params["cellSizeX"];
-    hog.cellSize.height = params["cellSizeY"];
+    PeopleClassifier classifier;
+    if (classifier.load(modelFile) != 0)
+    {
+        return 1;
+    }
+    cv::Mat weights;
+    float bias;
+    if (!classifier.getLinearModel(weights, bias))
+    {
+        return 0;
+    }
 
-    hog.nbins = params["nbins"];
-    hog.derivAperture = params["derivAperture"];
-    hog.winSigma = params["winSigma"];
-    hog.L2HysThreshold = params["L2HysThreshold"];
-    hog.gammaCorrection = static_cast<int>(params["gammaCorrection"]) != 0;
-    hog.nlevels = params["nlevels"];
-    hog.signedGradient = static_cast<int>(params["signedGradient"]) != 0;
+    QuantizedLinearModel model;
+    model.create(weights, bias, getHogBlockLength(hog));
+    model.calibrate(samples);
+    return model.appendTo(modelFile);
 }
 
 int trainMain(
     std::string annotationsFile,
     std::string imagesDir,
     std::string paramsFile,
-    std::string outputFile)
+    std::string outputFile,
+    int ioThreads,
+    size_t prefetchBytes,
+    bool useSgd,
+    std::string descriptorsFile,
+    SgdOptions sgdOptions,
+    std::string proposalCacheFile)
 {
+    if (useSgd && checkSgdOptions(sgdOptions) != 0)
+    {
+        return 1;
+    }
+    MemoryStage trainStage("train");
     cv::FileStorage params(paramsFile, cv::FileStorage::READ);
 
     cv::HOGDescriptor hog;
     createHog(params, hog);
 
-    std::vector<float> descriptors;
-    std::vector<cv::Mat> trainDataList;
+    std::vector<cv::Mat> trainDataList; // Descriptors of every image in rows
     std::vector<int> labelsList;
-    cv::Size windowSize(params["windowSizeX"], params["windowSizeY"]);
-    int sampleRngSeed = params["sampleRngSeed"];
-    float sampleSplitRatio = params["sampleSplitRatio"];
+    SampleOptions sampleOptions;
+    if (readSampleOptions(params, sampleOptions) != 0)
+    {
+        return 1;
+    }
+    DescriptorTransform transform;
+    transform.configure(readTransformOptions(params));
 
     std::vector<ImageAnnotation> annotations;
     if (readAnnotations(annotationsFile, annotations) != 0)
@@ -67,152 +90,432 @@ int trainMain(
         return 1;
     }
 
-    std::vector<std::string> allImages = getImagesSorted(imagesDir);
-    std::vector<std::string> trainImages = getTrainOrValidationSample(allImages, cv::RNG(sampleRngSeed), sampleSplitRatio, true);
+    ImageSource images;
+    if (images.open(imagesDir) != 0)
+    {
+        return 1;
+    }
 
-    for (auto b = trainImages.begin(), e = trainImages.end(); b != e; b++)
+    std::vector<std::string> allImages = images.getImageFiles();
+    std::vector<int> annotationCounts = countAnnotationsPerImage(allImages, annotations);
+    std::vector<std::string> trainImages = getTrainOrValidationSample(allImages, annotationCounts, sampleOptions, true);
+    ImagePrefetcher prefetcher(images, trainImages, ioThreads, prefetchBytes);
+    ProposalCache proposalCache;
+    if (proposalCache.open(proposalCacheFile) != 0)
     {
-        std::string imageFile = *b;
+        return 1;
+    }
+
+    // The streaming trainer reads descriptors back from disk instead of memory
+    DescriptorWriter descriptorWriter;
+    uint64_t descriptorsCount = 0;
+    if (useSgd && descriptorWriter.open(descriptorsFile, hog.getDescriptorSize()) != 0)
+    {
+        return 1;
+    }
+
+    std::unordered_map<std::string, std::vector<cv::Rect>> peopleBoxes;
+    groupPeopleBoxes(annotations, peopleBoxes);
+    const std::vector<cv::Rect> noPeople;
 
-        std::string imagePath = combinePath(imagesDir, imageFile);
-        cv::Mat trainImage = cv::imread(imagePath, cv::ImreadModes::IMREAD_GRAYSCALE);
-        if (trainImage.empty())
+    int64_t peopleCount = 0;
+    for (int i = 0; i < trainImages.size(); i++)
+    {
+        auto found = peopleBoxes.find(trainImages[i]);
+        peopleCount += found != peopleBoxes.end() ? found->second.size() : 0;
+    }
+    BackgroundSampler sampler(readBackgroundSamplingOptions(params), peopleCount);
+    // Windows of every image wait for the final sample when the global ratio is limited.
+    // The streaming trainer writes them at once with their keys and filters the file later.
+    std::vector<ImageSamples> heldSamples;
+    bool writesKeys = useSgd && sampler.isGloballyLimited();
+    std::string keysFile = descriptorsFile + ".keys";
+    std::ofstream keysStream;
+    if (writesKeys)
+    {
+        keysStream.open(keysFile, std::ios::binary);
+        if (!keysStream.is_open())
         {
-            std::cout << "Cannot open image " << imagePath << std::endl;
+            std::cout << "Can't open file to save keys " << keysFile << std::endl;
             return 1;
         }
-        std::vector<cv::Rect> peopleBoxes;
-        for (int i = 0; i < annotations.size(); i++)
+    }
+    int64_t backgroundProposals = 0;
+    int64_t backgroundWindows = 0;
+
+    auto appendSamples = [&](const ImageSamples &imageSamples)
+    {
+        for (int row = 0; row < imageSamples.Descriptors.rows; row++)
         {
-            if (annotations[i].FileName == imageFile)
+            bool isPerson = imageSamples.Labels[row] == Label::LABEL_PERSON;
+            backgroundWindows += isPerson ? 0 : 1;
+            if (useSgd && descriptorWriter.write(imageSamples.Descriptors.ptr<float>(row), isPerson) != 0)
+            {
+                std::cout << "Can't write descriptors file " << descriptorsFile << std::endl;
+                return 1;
+            }
+            if (writesKeys && !keysStream.write(reinterpret_cast<const char *>(&imageSamples.Keys[row]), sizeof(uint64_t)))
             {
-                peopleBoxes.push_back(annotations[i].Bbox);
+                std::cout << "Can't write keys file " << keysFile << std::endl;
+                return 1;
             }
         }
+        descriptorsCount += imageSamples.Descriptors.rows;
+        if (!useSgd && imageSamples.Descriptors.rows > 0)
+        {
+            trainDataList.push_back(imageSamples.Descriptors);
+            labelsList.insert(labelsList.end(), imageSamples.Labels.begin(), imageSamples.Labels.end());
+        }
+        return 0;
+    };
+
+    MemoryStage extractionStage("extraction");
+    cv::TickMeter extractionTimer;
+    extractionTimer.start();
+
+    // Images of a chunk are extracted in parallel, their blocks are kept in image order
+    const int chunkImages = 16 * cv::getNumThreads();
+    for (size_t chunkBegin = 0; chunkBegin < trainImages.size(); chunkBegin += chunkImages)
+    {
+        int chunkSize = static_cast<int>(std::min(trainImages.size() - chunkBegin, static_cast<size_t>(chunkImages)));
+        std::vector<PrefetchedImage> prefetched(chunkSize);
+        for (int i = 0; i < chunkSize; i++)
+        {
+            prefetcher.next(prefetched[i]);
+        }
+
+        std::vector<ImageSamples> samples(chunkSize);
+        std::vector<int> statuses(chunkSize, 0);
+        cv::parallel_for_(cv::Range(0, chunkSize), [&](const cv::Range &range)
+        {
+            for (int i = range.start; i < range.end; i++)
+            {
+                cv::Mat trainImage;
+                cv::Mat colorfulImage;
+                if (prefetcher.decode(prefetched[i], DECODE_GRAYSCALE, false, trainImage, colorfulImage) != 0)
+                {
+                    statuses[i] = 1;
+                    continue;
+                }
+
+                auto found = peopleBoxes.find(prefetched[i].ImageFile);
+                const std::vector<cv::Rect> &imagePeople = found != peopleBoxes.end() ? found->second : noPeople;
+                uint64_t proposalKey = getProposalKeyOfBytes(prefetched[i].Encoded, DECODE_GRAYSCALE);
+                std::vector<cv::Rect> proposals = proposalCache.findBoxes(proposalKey, trainImage);
+                extractImageSamples(hog, trainImage, proposals, imagePeople, sampler, static_cast<int>(chunkBegin) + i, samples[i]);
+            }
+        }, chunkSize);
 
-        std::vector<cv::Rect> contourBoxes = findBoxesOnBlackBackground(trainImage);
-        std::vector<cv::Rect> backgroundBoxes;
-        for (int i = 0; i < contourBoxes.size(); i++)
+        for (int i = 0; i < chunkSize; i++)
         {
-            if (!overlapsAny(contourBoxes[i], peopleBoxes))
+            if (statuses[i] != 0)
             {
-                backgroundBoxes.push_back(contourBoxes[i]);
+                std::cout << "Cannot open image " << images.getImagePath(prefetched[i].ImageFile) << std::endl;
+                return 1;
             }
+
+            backgroundProposals += samples[i].BackgroundProposals;
+            sampler.add(samples[i].Keys);
+            if (sampler.isGloballyLimited() && !useSgd)
+            {
+                heldSamples.push_back(std::move(samples[i]));
+            }
+            else if (appendSamples(samples[i]) != 0)
+            {
+                return 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < heldSamples.size(); i++)
+    {
+        ImageSamples selected;
+        sampler.selectRows(heldSamples[i], selected);
+        heldSamples[i] = ImageSamples();
+        if (appendSamples(selected) != 0)
+        {
+            return 1;
         }
+    }
+    extractionTimer.stop();
+    extractionStage.stop();
 
-        std::vector<cv::Rect> imageBoxes;
-        std::vector<Label> imageLabels;
-        for (int i = 0; i < peopleBoxes.size(); i++)
+    prefetcher.printStats();
+    proposalCache.printStats();
+    if (isArenaEnabled())
+    {
+        printArenaStats();
+    }
+    if (proposalCache.save() != 0)
+    {
+        return 1;
+    }
+    if (useSgd && descriptorWriter.close() != 0)
+    {
+        return 1;
+    }
+    if (writesKeys)
+    {
+        keysStream.close();
+        if (keysStream.fail())
         {
-            imageBoxes.push_back(peopleBoxes[i]);
-            imageLabels.push_back(Label::LABEL_PERSON);
+            std::cout << "Can't write keys file " << keysFile << std::endl;
+            return 1;
         }
-        for (int i = 0; i < backgroundBoxes.size(); i++)
+
+        // People have zero keys, so only background windows are dropped
+        std::string sampledFile = descriptorsFile + ".sampled";
+        if (filterDescriptorFile(descriptorsFile, keysFile, sampler.getMaxKey(), sampledFile, descriptorsCount) != 0)
         {
-            imageBoxes.push_back(backgroundBoxes[i]);
-            imageLabels.push_back(Label::LABEL_BACKGROUND);
+            return 1;
         }
+        backgroundWindows = static_cast<int64_t>(descriptorsCount) - peopleCount;
+        descriptorsFile = sampledFile;
+    }
+    std::cout << "Extraction: " << extractionTimer.getTimeMilli() << " ms, " << peopleCount << " people and "
+              << backgroundWindows << " of " << backgroundProposals << " background windows" << std::endl;
 
-        for (int i = 0; i < imageBoxes.size(); i++)
+    if (useSgd)
+    {
+        // The trainer then passes over the smaller compressed copy
+        std::string trainFile = descriptorsFile;
+        if (transform.needsFit())
         {
-            const cv::Rect box = imageBoxes[i];
-            const Label label = imageLabels[i];
+            trainFile = descriptorsFile + ".pca";
+            if (compressDescriptorFile(transform, descriptorsFile, trainFile) != 0)
+            {
+                return 1;
+            }
+        }
 
-            cv::Mat sliceImage = trainImage(box);
-            cv::Mat windowImage;
-            imresizeContain(sliceImage, windowImage, windowSize);
+        std::vector<float> weights;
+        float bias;
+        sgdOptions.Seed = sampleOptions.Seed;
+        MemoryStage sgdStage("sgd");
+        if (trainSgd(trainFile, sgdOptions, weights, bias) != 0)
+        {
+            return 1;
+        }
+        sgdStage.stop();
+        if (saveLinearSvm(outputFile, weights, bias, 1.0 / (sgdOptions.Lambda * descriptorsCount)) != 0 ||
+            transform.appendTo(outputFile) != 0)
+        {
+            return 1;
+        }
 
-            hog.compute(windowImage, descriptors);
-            trainDataList.push_back(cv::Mat(descriptors).clone());
-            labelsList.push_back(label);
+        DescriptorFile rawDescriptors;
+        if (rawDescriptors.open(descriptorsFile) != 0)
+        {
+            return 1;
         }
+        MemoryStage calibrationStage("calibration");
+        cv::Mat calibrationSamples;
+        rawDescriptors.copySample(CALIBRATION_WINDOWS, calibrationSamples);
+        return calibrateQuantizedScoring(outputFile, hog, calibrationSamples);
     }
 
-    int trainDataRows = trainDataList.size();
-    int trainDataCols = trainDataList[0].rows;
-    cv::Mat trainDataMatrix(trainDataRows, trainDataCols, CV_32FC1);
-    cv::Mat transposeTmpMatrix(1, trainDataCols, CV_32FC1);
+    if (trainDataList.empty())
+    {
+        std::cout << "No training windows found" << std::endl;
+        return 1;
+    }
+    // Both copies of the descriptors are alive here, this is usually the peak of training
+    MemoryStage concatStage("concat");
+    cv::Mat trainDataMatrix;
+    cv::vconcat(trainDataList, trainDataMatrix);
+    trainDataList.clear();
+    concatStage.stop();
+
+    cv::Mat calibrationSamples;
+    int calibrationStride = std::max(1, trainDataMatrix.rows / CALIBRATION_WINDOWS);
+    for (int row = 0; row < trainDataMatrix.rows && calibrationSamples.rows < CALIBRATION_WINDOWS; row += calibrationStride)
+    {
+        calibrationSamples.push_back(trainDataMatrix.row(row));
+    }
 
-    for (size_t i = 0; i < trainDataList.size(); i++)
+    if (transform.needsFit())
     {
-        cv::transpose(trainDataList[i], transposeTmpMatrix);
-        transposeTmpMatrix.copyTo(trainDataMatrix.row((int)i));
+        MemoryStage pcaStage("pca");
+        transform.fit(trainDataMatrix);
+        cv::Mat compressed;
+        transform.apply(trainDataMatrix, compressed);
+        trainDataMatrix = compressed;
     }
 
+    MemoryStage svmStage("svm");
     auto svm = cv::ml::SVM::create();
     svm->setType(cv::ml::SVM::C_SVC);
     svm->setKernel(cv::ml::SVM::LINEAR);
     svm->trainAuto(trainDataMatrix, cv::ml::ROW_SAMPLE, labelsList);
 
     svm->save(outputFile);
+    svmStage.stop();
 
-    return 0;
+    if (transform.appendTo(outputFile) != 0)
+    {
+        return 1;
+    }
+    MemoryStage calibrationStage("calibration");
+    return calibrateQuantizedScoring(outputFile, hog, calibrationSamples);
+}
+
+int loadClassifier(const std::string file, float threshold, bool quantized, PeopleClassifier &classifier)
+{
+    if (classifier.load(file) != 0)
+    {
+        return 1;
+    }
+    classifier.setThreshold(threshold);
+    return classifier.setQuantized(quantized);
 }
 
 int testMain(
+    std::string annotationsFile,
     std::string imagesDir,
     std::string paramsFile,
     std::string classifierCoefficientsFile,
-    std::string outputAnnotationsFile)
+    std::string outputAnnotationsFile,
+    float threshold,
+    bool quantized,
+    DecodePolicy decodePolicy,
+    bool showWindow,
+    std::string annotatedImagesDir,
+    int encodersCount,
+    int ioThreads,
+    size_t prefetchBytes,
+    std::string proposalCacheFile,
+    int batchSize)
 {
-    auto svm = cv::ml::SVM::load(classifierCoefficientsFile);
+    MemoryStage testStage("test");
+    PeopleClassifier classifier;
+    if (loadClassifier(classifierCoefficientsFile, threshold, quantized, classifier) != 0)
+    {
+        return 1;
+    }
 
     cv::FileStorage params(paramsFile, cv::FileStorage::READ);
     cv::HOGDescriptor hog;
     createHog(params, hog);
 
-    int sampleRngSeed = params["sampleRngSeed"];
-    float sampleSplitRatio = params["sampleSplitRatio"];
+    SampleOptions sampleOptions;
+    if (readSampleOptions(params, sampleOptions) != 0)
+    {
+        return 1;
+    }
 
     std::vector<cv::Rect> results;
 
-    bool shouldShow = true;
+    DetectionRenderer renderer(showWindow, annotatedImagesDir, encodersCount, 4);
+    // Grayscale decodes are converted to color by the renderer itself
+    bool withColor = renderer.isActive() && decodePolicy == DECODE_COLOR;
 
-    std::vector<std::string> allImages = getImagesSorted(imagesDir);
-    std::vector<std::string> testImages = getTrainOrValidationSample(allImages, cv::RNG(sampleRngSeed), sampleSplitRatio, false);
-    std::vector<ImageAnnotation> resultAnnotations;
-    for (auto b = testImages.begin(), e = testImages.end(); b != e; b++)
+    ImageSource images;
+    if (images.open(imagesDir) != 0)
     {
-        std::string imageFile = *b;
-        std::string imagePath = combinePath(imagesDir, imageFile);
-        cv::Mat testImage = cv::imread(imagePath, cv::ImreadModes::IMREAD_GRAYSCALE);
-        if (testImage.empty())
+        return 1;
+    }
+
+    std::vector<std::string> allImages = images.getImageFiles();
+    std::vector<int> annotationCounts;
+    if (sampleOptions.Stratify)
+    {
+        std::vector<ImageAnnotation> annotations;
+        if (readAnnotations(annotationsFile, annotations) != 0)
         {
-            std::cout << "Cannot open image " << imagePath << std::endl;
             return 1;
         }
+        annotationCounts = countAnnotationsPerImage(allImages, annotations);
+    }
+    std::vector<std::string> testImages = getTrainOrValidationSample(allImages, annotationCounts, sampleOptions, false);
+    std::vector<ImageAnnotation> resultAnnotations;
+    ImagePrefetcher prefetcher(images, testImages, ioThreads, prefetchBytes);
+    ProposalCache proposalCache;
+    if (proposalCache.open(proposalCacheFile) != 0)
+    {
+        return 1;
+    }
+    // Windows of a whole batch of images are scored by a single call
+    MemoryStage detectionStage("detection");
+    batchSize = std::max(batchSize, 1);
+    for (size_t batchBegin = 0; batchBegin < testImages.size(); batchBegin += batchSize)
+    {
+        int batchCount = static_cast<int>(std::min(testImages.size() - batchBegin, static_cast<size_t>(batchSize)));
+        std::vector<PrefetchedImage> prefetched(batchCount);
+        for (int i = 0; i < batchCount; i++)
+        {
+            prefetcher.next(prefetched[i]);
+        }
 
-        std::vector<cv::Rect> detectionBoxes;
-        if (detectPeople(svm, hog, testImage, detectionBoxes) != 0)
+        std::vector<cv::Mat> batchImages(batchCount);
+        std::vector<cv::Mat> colorfulImages(batchCount);
+        std::vector<std::vector<cv::Rect>> proposals(batchCount);
+        std::vector<int> statuses(batchCount, 0);
+        cv::parallel_for_(cv::Range(0, batchCount), [&](const cv::Range &range)
         {
-            std::cout << "Error during detection" << std::endl;
-            return 1;
+            for (int i = range.start; i < range.end; i++)
+            {
+                if (prefetcher.decode(prefetched[i], decodePolicy, withColor, batchImages[i], colorfulImages[i]) != 0)
+                {
+                    statuses[i] = 1;
+                    continue;
+                }
+                uint64_t proposalKey = getProposalKeyOfBytes(prefetched[i].Encoded, decodePolicy);
+                proposals[i] = proposalCache.findBoxes(proposalKey, batchImages[i]);
+            }
+        });
+        for (int i = 0; i < batchCount; i++)
+        {
+            if (statuses[i] != 0)
+            {
+                std::cout << "Cannot open image " << images.getImagePath(prefetched[i].ImageFile) << std::endl;
+                return 1;
+            }
         }
 
-        for (int i = 0; i < detectionBoxes.size(); i++)
+        std::vector<std::vector<cv::Rect>> detectionBoxes;
+        std::vector<std::vector<float>> detectionScores;
+        if (detectPeopleBatchInBoxes(classifier, hog, batchImages, proposals, detectionBoxes, detectionScores) != 0)
         {
-            ImageAnnotation a;
-            a.FileName = imageFile;
-            a.Bbox = detectionBoxes[i];
-            resultAnnotations.push_back(a);
+            std::cout << "Error during detection" << std::endl;
+            return 1;
         }
 
-        if (shouldShow)
+        for (int i = 0; i < batchCount; i++)
         {
-            cv::Mat colorfulImage = cv::imread(imagePath);
-            for (int i = 0; i < detectionBoxes.size(); i++)
+            for (int j = 0; j < detectionBoxes[i].size(); j++)
             {
-                cv::rectangle(colorfulImage, detectionBoxes[i], cv::Scalar(0, 0, 255));
+                ImageAnnotation a;
+                a.FileName = prefetched[i].ImageFile;
+                a.Bbox = detectionBoxes[i][j];
+                a.Score = detectionScores[i][j];
+                resultAnnotations.push_back(a);
             }
-            cv::imshow("Detection", colorfulImage);
-            if (cv::waitKey(5000) == -1)
+
+            if (renderer.isActive())
             {
-                shouldShow = false;
+                renderer.submit(prefetched[i].ImageFile, withColor ? colorfulImages[i] : batchImages[i], detectionBoxes[i]);
             }
         }
     }
 
-    if (writeAnnotations(outputAnnotationsFile, resultAnnotations) != 0)
+    renderer.finish();
+    detectionStage.stop();
+    prefetcher.printStats();
+    proposalCache.printStats();
+    if (isArenaEnabled())
+    {
+        printArenaStats();
+    }
+    if (proposalCache.save() != 0)
+    {
+        return 1;
+    }
+    if (renderer.getDroppedCount() > 0)
+    {
+        std::cout << "Visualization skipped " << renderer.getDroppedCount() << " images" << std::endl;
+    }
+
+    if (writeAnnotations(outputAnnotationsFile, resultAnnotations, true) != 0)
     {
         std::cout << "Can't save annotations" << std::endl;
         return 1;
@@ -225,14 +528,21 @@ int evaluateMain(
     std::string imagesDir,
     std::string paramsFile,
     std::string actualAnnotationsFile,
-    std::string detectedAnnotationsFile)
+    std::string detectedAnnotationsFile,
+    MatchMode matchMode)
 {
     cv::FileStorage params(paramsFile, cv::FileStorage::READ);
-    int sampleRngSeed = params["sampleRngSeed"];
-    float sampleSplitRatio = params["sampleSplitRatio"];
+    SampleOptions sampleOptions;
+    if (readSampleOptions(params, sampleOptions) != 0)
+    {
+        return 1;
+    }
 
-    auto allImages = getImagesSorted(imagesDir);
-    auto validationSample = getTrainOrValidationSample(allImages, cv::RNG(sampleRngSeed), sampleSplitRatio, false);
+    ImageSource images;
+    if (images.open(imagesDir) != 0)
+    {
+        return 1;
+    }
 
     std::vector<ImageAnnotation> actualAnnotations;
     if (readAnnotations(actualAnnotationsFile, actualAnnotations) != 0)
@@ -241,25 +551,46 @@ int evaluateMain(
         return 1;
     }
 
+    auto allImages = images.getImageFiles();
+    std::vector<int> annotationCounts = countAnnotationsPerImage(allImages, actualAnnotations);
+    auto validationSample = getTrainOrValidationSample(allImages, annotationCounts, sampleOptions, false);
+    std::unordered_set<std::string> validationSet(validationSample.begin(), validationSample.end());
+
     std::vector<ImageAnnotation> validationAnnotations;
     for (int i = 0; i < actualAnnotations.size(); i++)
     {
         std::string fileName = actualAnnotations[i].FileName;
-        bool isAnnotationFromValidationSet = std::find(validationSample.begin(), validationSample.end(), fileName) != validationSample.end();
+        bool isAnnotationFromValidationSet = validationSet.count(fileName) != 0;
         if (isAnnotationFromValidationSet)
         {
             validationAnnotations.push_back(actualAnnotations[i]);
         }
     }
 
-    std::vector<ImageAnnotation> detectedAnnotations;
-    if (readAnnotations(detectedAnnotationsFile, detectedAnnotations) != 0)
+    AnnotationColumns detectedColumns;
+    if (readAnnotationColumns(detectedAnnotationsFile, detectedColumns) != 0)
     {
         std::cout << "Can't read detected annotations" << std::endl;
         return 1;
     }
+    std::vector<ImageAnnotation> detectedAnnotations;
+    columnsToAnnotations(detectedColumns, detectedAnnotations);
+
+    // The summary and the curve share a single matching pass
+    GroupedAnnotations grouped;
+    groupAnnotationsByImage(validationAnnotations, detectedAnnotations, grouped);
+    std::vector<unsigned char> isCorrect;
+    matchDetections(grouped, matchMode, isCorrect);
+
+    EvaluationResult result = evaluateDetections(grouped, isCorrect);
+    printEvaluationResult(result);
 
-    evaluateDetectionAnnotations(validationAnnotations, detectedAnnotations);
+    if (!detectedColumns.Scores.empty())
+    {
+        // Lower thresholds of the test command put more of the curve into the results
+        PrecisionRecallCurve curve = computePrecisionRecallCurve(grouped, isCorrect);
+        printPrecisionRecallCurve(curve, {0.8, 0.9, 0.95, 0.99});
+    }
 
     return 0;
 }
@@ -267,29 +598,57 @@ int evaluateMain(
 int detectMain(
     std::string classifierCoefficientsFile,
     std::string paramsFile,
-    std::string imagePath)
+    std::string imagePath,
+    float threshold,
+    bool quantized,
+    DecodePolicy decodePolicy,
+    std::string proposalCacheFile)
 {
-    auto svm = cv::ml::SVM::load(classifierCoefficientsFile);
+    PeopleClassifier classifier;
+    if (loadClassifier(classifierCoefficientsFile, threshold, quantized, classifier) != 0)
+    {
+        return 1;
+    }
 
     cv::FileStorage params(paramsFile, cv::FileStorage::READ);
     cv::HOGDescriptor hog;
     createHog(params, hog);
 
-    cv::Mat grayscaleImage = cv::imread(imagePath, cv::ImreadModes::IMREAD_GRAYSCALE);
-    if (grayscaleImage.empty())
+    // Proposals are keyed by the encoded bytes, the same as other commands do
+    std::vector<unsigned char> bytes;
+    cv::Mat grayscaleImage;
+    cv::Mat colorfulImage;
+    if (readFileBytes(imagePath, bytes) != 0 || bytes.empty())
     {
         std::cout << "Cannot open image " << imagePath << std::endl;
         return 1;
     }
+    cv::Mat encoded(1, static_cast<int>(bytes.size()), CV_8UC1, bytes.data());
+    if (decodeImage(encoded, decodePolicy, true, grayscaleImage, colorfulImage) != 0)
+    {
+        std::cout << "Cannot open image " << imagePath << std::endl;
+        return 1;
+    }
+
+    ProposalCache proposalCache;
+    if (proposalCache.open(proposalCacheFile) != 0)
+    {
+        return 1;
+    }
+    std::vector<cv::Rect> proposals = proposalCache.findBoxes(getProposalKeyOfBytes(encoded, decodePolicy), grayscaleImage);
+    if (proposalCache.save() != 0)
+    {
+        return 1;
+    }
 
     std::vector<cv::Rect> detectionBoxes;
-    if (detectPeople(svm, hog, grayscaleImage, detectionBoxes) != 0)
+    std::vector<float> detectionScores;
+    if (detectPeopleInBoxes(classifier, hog, grayscaleImage, proposals, detectionBoxes, detectionScores) != 0)
     {
         std::cout << "Error during detection" << std::endl;
         return 1;
     }
 
-    cv::Mat colorfulImage = cv::imread(imagePath);
     for (int i = 0; i < detectionBoxes.size(); i++)
     {
         cv::rectangle(colorfulImage, detectionBoxes[i], cv::Scalar(0, 0, 255));
@@ -301,106 +660,346 @@ int detectMain(
     return 0;
 }
 
+int convertMain(
+    std::string inputAnnotationsFile,
+    std::string outputAnnotationsFile)
+{
+    AnnotationColumns columns;
+    if (readAnnotationColumns(inputAnnotationsFile, columns) != 0)
+    {
+        std::cout << "Can't read annotations" << std::endl;
+        return 1;
+    }
+
+    if (isBinaryAnnotationsFile(outputAnnotationsFile))
+    {
+        return writeAnnotationColumns(outputAnnotationsFile, columns);
+    }
+
+    std::vector<ImageAnnotation> annotations;
+    columnsToAnnotations(columns, annotations);
+    return writeAnnotations(outputAnnotationsFile, annotations, !columns.Scores.empty());
+}
+
+int detectVideoMain(
+    std::string classifierCoefficientsFile,
+    std::string paramsFile,
+    std::string videoPath,
+    std::string outputAnnotationsFile,
+    float threshold,
+    bool quantized,
+    const VideoDetectionOptions &options)
+{
+    PeopleClassifier classifier;
+    if (loadClassifier(classifierCoefficientsFile, threshold, quantized, classifier) != 0)
+    {
+        return 1;
+    }
+
+    cv::FileStorage params(paramsFile, cv::FileStorage::READ);
+    cv::HOGDescriptor hog;
+    createHog(params, hog);
+
+    return detectVideo(classifier, hog, videoPath, outputAnnotationsFile, options);
+}
+
+int manifestMain(
+    std::string imagesDir,
+    std::string manifestFile,
+    bool withDimensions)
+{
+    DatasetManifest manifest;
+    if (createManifest(imagesDir, withDimensions, manifest) != 0)
+    {
+        return 1;
+    }
+    if (writeManifest(manifestFile, manifest) != 0)
+    {
+        return 1;
+    }
+
+    std::cout << "Listed " << manifest.Entries.size() << " images in " << manifestFile << std::endl;
+    return 0;
+}
+
+// A manifest given by -m replaces the directory listing of -i
+std::string readImagesLocation(const cv::CommandLineParser &cli)
+{
+    std::string manifestFile = cli.get<std::string>("m");
+    return manifestFile.empty() ? cli.get<std::string>("i") : manifestFile;
+}
+
+size_t readPrefetchBytes(const cv::CommandLineParser &cli)
+{
+    return static_cast<size_t>(cli.get<double>("prefetch") * 1024 * 1024);
+}
+
+DecodePolicy readDecodePolicy(const cv::CommandLineParser &cli)
+{
+    return cli.get<std::string>("decode") == "color" ? DECODE_COLOR : DECODE_GRAYSCALE;
+}
+
+SgdOptions readSgdOptions(const cv::CommandLineParser &cli)
+{
+    SgdOptions options;
+    options.Epochs = cli.get<int>("epochs");
+    options.BatchSize = cli.get<int>("batch");
+    options.Lambda = cli.get<double>("lambda");
+    options.Seed = 0; // Taken from the classifier parameters
+    return options;
+}
+
+int readVideoDetectionOptions(const cv::CommandLineParser &cli, VideoDetectionOptions &options)
+{
+    options.FrameSkip = cli.get<int>("skip");
+    options.MaxFps = cli.get<double>("fps");
+    options.Workers = cli.get<int>("w");
+    options.QueueSize = cli.get<int>("q");
+    options.DropWhenBehind = cli.has("drop");
+    options.Incremental = cli.has("incremental");
+    options.TileSize = cli.get<int>("tile");
+    options.RefreshInterval = cli.get<int>("refresh");
+    options.PixelTolerance = cli.get<int>("tolerance");
+    if (options.FrameSkip < 0 || options.MaxFps < 0 || options.Workers < 0 || options.QueueSize < 0)
+    {
+        std::cout << "Video options skip, fps, w and q can't be negative" << std::endl;
+        return 1;
+    }
+    if (options.TileSize < 1)
+    {
+        std::cout << "Video option tile must be positive" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     cv::String cliKeys =
-        "{@commandType|<none>              | Command type               }"
-        "{a           |../simple/bboxes.txt| Annotations file           }"
-        "{i           |../simple/images/   | Images directory           }"
-        "{p           |../params.yml       | Classifier parameters      }"
-        "{c           |../model.yml        | Classifier coefficients    }"
-        "{o           |../results.txt      | Classified annotations file}"
-        "{d           |<none>              | Image to detect pedestrian }";
+        "{@commandType|<none>              | Command type                                 }"
+        "{@benchmark  |                    | Benchmark name for the bench command         }"
+        "{n           |10000000            | Synthetic records generated by benchmarks    }"
+        "{images      |1000                | Synthetic images of the arena benchmark      }"
+        "{a           |../simple/bboxes.txt| Annotations file                             }"
+        "{i           |../simple/images/   | Images directory or packed archive           }"
+        "{m           |                    | Images manifest read instead of -i or written}"
+        "{archive     |                    | Packed images archive written by pack        }"
+        "{dims        |                    | Record image dimensions in the manifest      }"
+        "{p           |../params.yml       | Classifier parameters                        }"
+        "{grid        |../sweep.yml        | HOG configurations of the sweep command      }"
+        "{csv         |../sweep.csv        | Results of the sweep command                 }"
+        "{c           |../model.yml        | Classifier coefficients                      }"
+        "{o           |../results.txt      | Classified annotations file                  }"
+        "{d           |<none>              | Image to detect pedestrian                   }"
+        "{t           |0                   | Score above which a window is a person       }"
+        "{b           |8                   | Test images scored in a single batch         }"
+        "{int8        |                    | Score int8 descriptors with float near t     }"
+        "{match       |half                | Eval rule: half of actual area or iou        }"
+        "{decode      |gray                | Decode for visualization: gray or color      }"
+        "{show        |true                | Show detections of the test command          }"
+        "{annotated   |                    | Directory for annotated test images          }"
+        "{encoders    |2                   | Threads writing annotated test images        }"
+        "{io          |2                   | Threads reading images ahead                 }"
+        "{prefetch    |64                  | Megabytes of images read ahead               }"
+        "{arena       |                    | Per-image Mats from thread-local arenas      }"
+        "{memory      |                    | Print allocations and peak memory by stage   }"
+        "{memoryJson  |                    | Also write memory by stage to this JSON file }"
+        "{proposals   |../proposals.bin    | Proposal cache file, empty to disable        }"
+        "{sgd         |                    | Train by streaming SGD with bounded memory   }"
+        "{descriptors |../descriptors.bin  | Descriptors file used by the SGD trainer     }"
+        "{epochs      |5                   | SGD passes over the descriptors file         }"
+        "{batch       |256                 | Descriptors in an SGD mini-batch             }"
+        "{lambda      |0.0001              | SGD regularization                           }"
+        "{v           |<none>              | Video to detect pedestrians                  }"
+        "{skip        |0                   | Video frames skipped after each detected one }"
+        "{fps         |0                   | Max detected video frames per second, 0 - any}"
+        "{w           |0                   | Detection worker threads, 0 - CPU count      }"
+        "{q           |0                   | Video frames queued for detection, 0 - auto  }"
+        "{drop        |                    | Drop video frames when detection falls behind}"
+        "{incremental |                    | Reuse proposals of unchanged video tiles     }"
+        "{tile        |32                  | Tile size compared between video frames      }"
+        "{refresh     |30                  | Video frames between full recomputations     }"
+        "{tolerance   |8                   | Pixel difference not treated as a change     }";
     cv::CommandLineParser cli(argc, argv, cliKeys);
 
     std::string commandType = cli.get<std::string>("@commandType");
+    // Counting goes first so the arena falls back to the counted allocator
+    if (cli.has("memory") || !cli.get<std::string>("memoryJson").empty())
+    {
+        enableMemoryAccounting(cli.get<std::string>("memoryJson"));
+    }
+    setArenaEnabled(cli.has("arena"));
     if (commandType == "train")
     {
         return trainMain(
             cli.get<std::string>("a"),
-            cli.get<std::string>("i"),
+            readImagesLocation(cli),
             cli.get<std::string>("p"),
-            cli.get<std::string>("c"));
+            cli.get<std::string>("c"),
+            cli.get<int>("io"),
+            readPrefetchBytes(cli),
+            cli.has("sgd"),
+            cli.get<std::string>("descriptors"),
+            readSgdOptions(cli),
+            cli.get<std::string>("proposals"));
+    }
+    if (commandType == "sweep")
+    {
+        return sweepMain(
+            cli.get<std::string>("a"),
+            readImagesLocation(cli),
+            cli.get<std::string>("p"),
+            cli.get<std::string>("grid"),
+            cli.get<std::string>("csv"),
+            cli.get<int>("io"),
+            readPrefetchBytes(cli),
+            cli.get<std::string>("proposals"));
     }
     if (commandType == "test")
     {
         return testMain(
-            cli.get<std::string>("i"),
+            cli.get<std::string>("a"),
+            readImagesLocation(cli),
             cli.get<std::string>("p"),
             cli.get<std::string>("c"),
-            cli.get<std::string>("o"));
+            cli.get<std::string>("o"),
+            cli.get<float>("t"),
+            cli.has("int8"),
+            readDecodePolicy(cli),
+            cli.get<bool>("show"),
+            cli.get<std::string>("annotated"),
+            cli.get<int>("encoders"),
+            cli.get<int>("io"),
+            readPrefetchBytes(cli),
+            cli.get<std::string>("proposals"),
+            cli.get<int>("b"));
     }
     if (commandType == "eval")
     {
         return evaluateMain(
-            cli.get<std::string>("i"),
+            readImagesLocation(cli),
             cli.get<std::string>("p"),
             cli.get<std::string>("a"),
-            cli.get<std::string>("o"));
+            cli.get<std::string>("o"),
+            cli.get<std::string>("match") == "iou" ? MATCH_IOU : MATCH_HALF_ACTUAL_AREA);
     }
     if (commandType == "detect")
     {
         return detectMain(
             cli.get<std::string>("c"),
             cli.get<std::string>("p"),
-            cli.get<std::string>("d"));
+            cli.get<std::string>("d"),
+            cli.get<float>("t"),
+            cli.has("int8"),
+            readDecodePolicy(cli),
+            cli.get<std::string>("proposals"));
     }
 
-    std::cout << "Unknown command type." << std::endl;
-    cli.printMessage();
-    return 1;
-}
-
-cv::Mat stdVectorToSamplesCvMat(std::vector<cv::Mat> &vec)
-{
-    int testDataRows = vec.size();
-    int testDataCols = vec[0].rows;
-    cv::Mat testDataMatrix(testDataRows, testDataCols, CV_32FC1);
-    cv::Mat transposeTmpMatrix(1, testDataCols, CV_32FC1);
-
-    for (size_t i = 0; i < vec.size(); i++)
+    if (commandType == "pack")
+    {
+        if (cli.get<std::string>("archive").empty())
+        {
+            std::cout << "Specify the archive file with -archive" << std::endl;
+            return 1;
+        }
+        return packImages(
+            cli.get<std::string>("i"),
+            cli.get<std::string>("archive"));
+    }
+    if (commandType == "manifest")
     {
-        cv::transpose(vec[i], transposeTmpMatrix);
-        transposeTmpMatrix.copyTo(testDataMatrix.row((int)i));
+        if (cli.get<std::string>("m").empty())
+        {
+            std::cout << "Specify the manifest file with -m" << std::endl;
+            return 1;
+        }
+        return manifestMain(
+            cli.get<std::string>("i"),
+            cli.get<std::string>("m"),
+            cli.has("dims"));
     }
+    if (commandType == "convert")
+    {
+        return convertMain(
+            cli.get<std::string>("a"),
+            cli.get<std::string>("o"));
+    }
+    if (commandType == "detect-video")
+    {
+        VideoDetectionOptions videoOptions;
+        if (readVideoDetectionOptions(cli, videoOptions) != 0)
+        {
+            return 1;
+        }
+        return detectVideoMain(
+            cli.get<std::string>("c"),
+            cli.get<std::string>("p"),
+            cli.get<std::string>("v"),
+            cli.get<std::string>("o"),
+            cli.get<float>("t"),
+            cli.has("int8"),
+            videoOptions);
+    }
+    if (commandType == "bench")
+    {
+        std::string benchmark = cli.get<std::string>("@benchmark");
+        if (benchmark == "video")
+        {
+            VideoDetectionOptions videoOptions;
+            if (readVideoDetectionOptions(cli, videoOptions) != 0)
+            {
+                return 1;
+            }
+            return benchVideoMain(
+                cli.get<std::string>("i"),
+                cli.get<std::string>("p"),
+                cli.get<std::string>("c"),
+                videoOptions);
+        }
 
-    return testDataMatrix;
-}
+        if (benchmark == "raw")
+        {
+            return benchRawMain(
+                cli.get<std::string>("i"),
+                cli.get<std::string>("p"),
+                cli.get<std::string>("c"));
+        }
 
-int detectPeople(
-    const cv::Ptr<cv::ml::SVM> &svm,
-    const cv::HOGDescriptor &hog,
-    const cv::Mat image,
-    std::vector<cv::Rect> &locations)
-{
-    std::vector<float> descriptors;
-    std::vector<cv::Mat> testDataList;
+        if (benchmark == "annotations")
+        {
+            return benchAnnotationsMain(cli.get<int>("n"));
+        }
 
-    std::vector<cv::Rect> boxes = findBoxesOnBlackBackground(image);
-    for (int i = 0; i < boxes.size(); i++)
-    {
-        cv::Mat imageObject = image(boxes[i]);
-        cv::Mat resizedObject;
-        imresizeContain(imageObject, resizedObject, hog.winSize);
+        if (benchmark == "matcher")
+        {
+            return benchMatcherMain();
+        }
 
-        hog.compute(resizedObject, descriptors);
-        testDataList.push_back(cv::Mat(descriptors).clone());
-    }
+        if (benchmark == "pack")
+        {
+            return benchPackMain(cli.get<std::string>("i"));
+        }
 
-    cv::Mat testDataMatrix = stdVectorToSamplesCvMat(testDataList);
+        if (benchmark == "pca")
+        {
+            return benchPcaMain(cli.get<std::string>("descriptors"));
+        }
 
-    cv::Mat results;
-    svm->predict(testDataMatrix, results, cv::ml::ROW_SAMPLE);
+        if (benchmark == "arena")
+        {
+            return benchArenaMain(cli.get<int>("images"), cli.get<std::string>("p"));
+        }
 
-    for (int i = 0; i < results.rows && i < boxes.size(); i++)
-    {
-        if (results.at<float>(i, 0) != Label::LABEL_PERSON)
+        if (benchmark == "rff")
         {
-            continue;
+            return benchRffMain(cli.get<std::string>("descriptors"), cli.get<std::string>("p"));
         }
 
-        locations.push_back(boxes[i]);
+        std::cout << "Unknown benchmark." << std::endl;
+        return 1;
     }
 
-    return 0;
+    std::cout << "Unknown command type." << std::endl;
+    cli.printMessage();
+    return 1;
 }
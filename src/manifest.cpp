@@ -0,0 +1,280 @@
+#include "manifest.h"
+#include "ioUtils.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+// Text layout: magic line, "<dir mtime>\t<count>\t<images dir>",
+// then "<name>\t<size>\t<mtime>\t<width>\t<height>" for every image
+static const char MANIFEST_MAGIC[] = "PPLMANIFEST 1";
+
+int getFileStat(const std::string path, uint64_t &size, int64_t &modifiedTime)
+{
+#ifdef _WIN32
+    // Windows can't stat directories given with a trailing separator
+    std::string trimmedPath = path;
+    while (trimmedPath.size() > 1 && (trimmedPath.back() == '/' || trimmedPath.back() == '\\'))
+    {
+        trimmedPath.pop_back();
+    }
+    struct _stat64 fileStat;
+    if (_stat64(trimmedPath.c_str(), &fileStat) != 0)
+    {
+        return 1;
+    }
+#else
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0)
+    {
+        return 1;
+    }
+#endif
+    size = static_cast<uint64_t>(fileStat.st_size);
+    modifiedTime = static_cast<int64_t>(fileStat.st_mtime);
+    return 0;
+}
+
+int getModifiedTime(const std::string path, int64_t &result)
+{
+    uint64_t size;
+    return getFileStat(path, size, result);
+}
+
+// Manifests are read from other working directories than the one they were created in
+static int getAbsolutePath(const std::string path, std::string &result)
+{
+#ifdef _WIN32
+    char *absolutePath = _fullpath(nullptr, path.c_str(), 0);
+#else
+    char *absolutePath = realpath(path.c_str(), nullptr);
+#endif
+    if (absolutePath == nullptr)
+    {
+        return 1;
+    }
+    result = absolutePath;
+    free(absolutePath);
+    // realpath drops the trailing separator the directory was given with
+    if (result.back() != '/' && result.back() != '\\')
+    {
+        result += '/';
+    }
+    return 0;
+}
+
+// Finds the frame header without decoding the image
+static bool readJpegSize(const std::vector<unsigned char> &bytes, int &width, int &height)
+{
+    size_t i = 2;
+    if (bytes.size() < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8)
+    {
+        return false;
+    }
+    while (i + 4 <= bytes.size())
+    {
+        if (bytes[i] != 0xFF)
+        {
+            return false;
+        }
+        unsigned char marker = bytes[i + 1];
+        if (marker == 0xFF)
+        {
+            i++;
+            continue;
+        }
+        size_t length = (bytes[i + 2] << 8) | bytes[i + 3];
+        bool isFrameHeader = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (isFrameHeader)
+        {
+            if (i + 9 > bytes.size())
+            {
+                return false;
+            }
+            height = (bytes[i + 5] << 8) | bytes[i + 6];
+            width = (bytes[i + 7] << 8) | bytes[i + 8];
+            return true;
+        }
+        i += 2 + length;
+    }
+    return false;
+}
+
+bool isManifestFile(const std::string file)
+{
+    std::ifstream f(file, std::ios::binary);
+    char magic[sizeof(MANIFEST_MAGIC) - 1];
+    f.read(magic, sizeof(magic));
+    return f.gcount() == sizeof(magic) && std::memcmp(magic, MANIFEST_MAGIC, sizeof(magic)) == 0;
+}
+
+// Splits the line at tabs, returns false if there are fewer fields than expected
+static bool splitFields(const char *begin, const char *end, const char **fields, int count)
+{
+    fields[0] = begin;
+    for (int i = 1; i < count; i++)
+    {
+        const char *tab = static_cast<const char *>(std::memchr(fields[i - 1], '\t', end - fields[i - 1]));
+        if (tab == nullptr)
+        {
+            return false;
+        }
+        fields[i] = tab + 1;
+    }
+    return true;
+}
+
+int readManifest(const std::string file, DatasetManifest &result)
+{
+    std::vector<unsigned char> bytes;
+    if (readFileBytes(file, bytes) != 0)
+    {
+        std::cout << "Can't read manifest " << file << std::endl;
+        return 1;
+    }
+
+    const char *data = reinterpret_cast<const char *>(bytes.data());
+    const char *end = data + bytes.size();
+    const char *line = data;
+    int lineNumber = 0;
+    size_t count = 0;
+    result.Entries.clear();
+    while (line < end)
+    {
+        const char *lineEnd = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        const char *next = lineEnd == nullptr ? end : lineEnd + 1;
+        if (lineEnd == nullptr)
+        {
+            lineEnd = end;
+        }
+        if (lineEnd > line && lineEnd[-1] == '\r')
+        {
+            lineEnd--;
+        }
+        lineNumber++;
+
+        const char *fields[5];
+        bool isValid;
+        if (lineNumber == 1)
+        {
+            isValid = std::string(line, lineEnd) == MANIFEST_MAGIC;
+        }
+        else if (lineNumber == 2)
+        {
+            isValid = splitFields(line, lineEnd, fields, 3);
+            if (isValid)
+            {
+                result.DirModifiedTime = std::strtoll(fields[0], nullptr, 10);
+                count = std::strtoull(fields[1], nullptr, 10);
+                result.ImagesDir = std::string(fields[2], lineEnd);
+                result.Entries.reserve(count);
+            }
+        }
+        else
+        {
+            isValid = splitFields(line, lineEnd, fields, 5);
+            if (isValid)
+            {
+                ManifestEntry entry;
+                entry.FileName = std::string(fields[0], fields[1] - 1);
+                entry.Size = std::strtoull(fields[1], nullptr, 10);
+                entry.ModifiedTime = std::strtoll(fields[2], nullptr, 10);
+                entry.Width = std::atoi(fields[3]);
+                entry.Height = std::atoi(fields[4]);
+                result.Entries.push_back(entry);
+            }
+        }
+
+        if (!isValid)
+        {
+            std::cout << "Malformed manifest line " << file << ":" << lineNumber << std::endl;
+            return 1;
+        }
+        line = next;
+    }
+
+    if (lineNumber < 2 || result.Entries.size() != count)
+    {
+        std::cout << "Truncated manifest " << file << std::endl;
+        return 1;
+    }
+    for (size_t i = 1; i < result.Entries.size(); i++)
+    {
+        if (!(result.Entries[i - 1].FileName < result.Entries[i].FileName))
+        {
+            std::cout << "Unsorted manifest " << file << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int writeManifest(const std::string file, const DatasetManifest &manifest)
+{
+    std::ofstream f;
+    f.open(file, std::ios::binary);
+    if (!f.is_open())
+    {
+        std::cout << "Can't open file to save manifest " << file << std::endl;
+        return 1;
+    }
+
+    f << MANIFEST_MAGIC << '\n';
+    f << manifest.DirModifiedTime << '\t' << manifest.Entries.size() << '\t' << manifest.ImagesDir << '\n';
+    for (int i = 0; i < manifest.Entries.size(); i++)
+    {
+        const ManifestEntry &entry = manifest.Entries[i];
+        f << entry.FileName << '\t' << entry.Size << '\t' << entry.ModifiedTime << '\t'
+          << entry.Width << '\t' << entry.Height << '\n';
+    }
+    f.close();
+    if (f.fail())
+    {
+        std::cout << "Can't write manifest " << file << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int createManifest(const std::string imagesDir, bool withDimensions, DatasetManifest &result)
+{
+    result.Entries.clear();
+    if (getModifiedTime(imagesDir, result.DirModifiedTime) != 0 || getAbsolutePath(imagesDir, result.ImagesDir) != 0)
+    {
+        std::cout << "Can't open images directory " << imagesDir << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> images = getImagesSorted(imagesDir);
+    result.Entries.reserve(images.size());
+    std::vector<unsigned char> bytes;
+    for (int i = 0; i < images.size(); i++)
+    {
+        std::string imagePath = combinePath(imagesDir, images[i]);
+        ManifestEntry entry;
+        entry.FileName = images[i];
+        entry.Width = 0;
+        entry.Height = 0;
+        if (getFileStat(imagePath, entry.Size, entry.ModifiedTime) != 0)
+        {
+            std::cout << "Cannot open image " << imagePath << std::endl;
+            return 1;
+        }
+        if (withDimensions)
+        {
+            if (readFileBytes(imagePath, bytes) != 0 || !readJpegSize(bytes, entry.Width, entry.Height))
+            {
+                std::cout << "Can't read size of image " << imagePath << std::endl;
+            }
+        }
+        result.Entries.push_back(entry);
+    }
+    return 0;
+}
+
+bool isManifestUpToDate(const DatasetManifest &manifest)
+{
+    int64_t modifiedTime;
+    return getModifiedTime(manifest.ImagesDir, modifiedTime) == 0 && modifiedTime == manifest.DirModifiedTime;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ManifestEntry
+{
+    std::string FileName;
+    uint64_t Size;
+    int64_t ModifiedTime;
+    int Width;  // 0 when dimensions weren't recorded
+    int Height;
+};
+
+// Listing of an images directory saved once by the manifest command,
+// so commands don't need to scan and sort the directory on every run
+struct DatasetManifest
+{
+    std::string ImagesDir;
+    int64_t DirModifiedTime;
+    std::vector<ManifestEntry> Entries; // Sorted by name like getImagesSorted
+};
+
+bool isManifestFile(const std::string file);
+
+// Loads a manifest in one pass over the file without touching the directory
+int readManifest(const std::string file, DatasetManifest &result);
+int writeManifest(const std::string file, const DatasetManifest &manifest);
+
+// Lists the directory once, image dimensions are read from JPEG headers if asked
+int createManifest(const std::string imagesDir, bool withDimensions, DatasetManifest &result);
+
+// A file added to or removed from the directory changes its modification time
+bool isManifestUpToDate(const DatasetManifest &manifest);
+
+int getModifiedTime(const std::string path, int64_t &result);
+int getFileStat(const std::string path, uint64_t &size, int64_t &modifiedTime);
@@ -0,0 +1,243 @@
+#include "mappedFile.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 16K and 64K pages exist, madvise rejects ranges not aligned to the real size
+static size_t getPageSize()
+{
+#ifdef _WIN32
+    static const size_t pageSize = []()
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return static_cast<size_t>(info.dwPageSize);
+    }();
+#else
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    return pageSize;
+}
+
+#ifndef _WIN32
+// Failures don't stop the pass over the file, but memory then grows with it
+static void adviseMapping(char *begin, size_t length, int advice)
+{
+    static std::atomic<bool> isReported(false);
+    if (madvise(begin, length, advice) != 0 && !isReported.exchange(true))
+    {
+        std::cout << "Can't advise mapped file pages: " << std::strerror(errno) << std::endl;
+    }
+}
+#endif
+
+MappedFile::MappedFile()
+    : mappedData(nullptr),
+      mappedSize(0),
+#ifdef _WIN32
+      fileHandle(INVALID_HANDLE_VALUE),
+      mappingHandle(nullptr)
+#else
+      fileDescriptor(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string path)
+{
+    close();
+
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize))
+    {
+        close();
+        return false;
+    }
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+    if (mappedSize == 0)
+    {
+        // Empty files can't be mapped but are still valid
+        return true;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    mappedData = static_cast<const char *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (mappedData == nullptr)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mappedData != nullptr)
+    {
+        UnmapViewOfFile(mappedData);
+    }
+    if (mappingHandle != nullptr)
+    {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(fileHandle);
+    }
+    mappedData = nullptr;
+    mappedSize = 0;
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const std::string path)
+{
+    close();
+
+    fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0)
+    {
+        close();
+        return false;
+    }
+    mappedSize = static_cast<size_t>(fileStat.st_size);
+    if (mappedSize == 0)
+    {
+        // Empty files can't be mapped but are still valid
+        return true;
+    }
+
+    void *mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+    mappedData = static_cast<const char *>(mapping);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mappedData != nullptr)
+    {
+        munmap(const_cast<char *>(mappedData), mappedSize);
+    }
+    if (fileDescriptor >= 0)
+    {
+        ::close(fileDescriptor);
+    }
+    mappedData = nullptr;
+    mappedSize = 0;
+    fileDescriptor = -1;
+}
+
+#endif
+
+const char *MappedFile::data() const
+{
+    return mappedData;
+}
+
+size_t MappedFile::size() const
+{
+    return mappedSize;
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+    if (mappedData == nullptr || offset >= mappedSize)
+    {
+        return;
+    }
+    length = std::min(length, mappedSize - offset);
+    if (length == 0)
+    {
+        return;
+    }
+
+    const size_t pageSize = getPageSize();
+#ifndef _WIN32
+    size_t alignedOffset = offset / pageSize * pageSize;
+    adviseMapping(const_cast<char *>(mappedData) + alignedOffset, length + offset - alignedOffset, MADV_WILLNEED);
+#endif
+
+    // Touching every page makes sure it is resident when the decoder gets to it
+    volatile char sink = 0;
+    for (size_t i = offset; i < offset + length; i += pageSize)
+    {
+        sink += mappedData[i];
+    }
+    sink += mappedData[offset + length - 1];
+}
+
+void MappedFile::release(size_t offset, size_t length) const
+{
+    if (mappedData == nullptr || offset >= mappedSize)
+    {
+        return;
+    }
+    length = std::min(length, mappedSize - offset);
+
+    // Pages partially outside of the range may still be in use
+    const size_t pageSize = getPageSize();
+    size_t alignedBegin = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t alignedEnd = (offset + length) / pageSize * pageSize;
+    if (offset + length == mappedSize)
+    {
+        alignedEnd = offset + length;
+    }
+    if (alignedEnd <= alignedBegin)
+    {
+        return;
+    }
+
+    char *begin = const_cast<char *>(mappedData) + alignedBegin;
+#ifdef _WIN32
+    // Unlocking pages that aren't locked removes them from the working set
+    VirtualUnlock(begin, alignedEnd - alignedBegin);
+#else
+    adviseMapping(begin, alignedEnd - alignedBegin, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into memory
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string path);
+    void close();
+
+    const char *data() const;
+    size_t size() const;
+
+    // Pulls the range into memory ahead of use
+    void prefetch(size_t offset, size_t length) const;
+    // Drops whole pages of the range from memory, they are read again when touched
+    void release(size_t offset, size_t length) const;
+
+private:
+    const char *mappedData;
+    size_t mappedSize;
+#ifdef _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
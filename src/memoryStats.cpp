@@ -0,0 +1,383 @@
+#include "memoryStats.h"
+#include <opencv2/core/core.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+static std::atomic<bool> accountingEnabled(false);
+static std::atomic<int64_t> allocations(0);
+static std::atomic<int64_t> allocatedBytes(0);
+static std::atomic<int64_t> liveBytes(0);
+static std::atomic<int64_t> peakLiveBytes(0);
+
+static std::mutex stagesMutex;
+static std::vector<StageMemory> stages;
+static int stageDepth = 0;
+static std::string reportJsonFile;
+
+void recordAllocation(size_t bytes)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+    int64_t live = liveBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+    int64_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+void recordFree(size_t bytes)
+{
+    liveBytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+}
+
+// Every block of operator new starts with the size it was counted with, zero when
+// accounting was off. Frees then match allocations whenever accounting is enabled,
+// and a run without it pays no atomics for the header.
+static const size_t BLOCK_HEADER_SIZE = alignof(std::max_align_t);
+
+static void *allocateBlock(size_t size)
+{
+    size = size > 0 ? size : 1;
+    if (size > SIZE_MAX - BLOCK_HEADER_SIZE)
+    {
+        return nullptr;
+    }
+    unsigned char *block = static_cast<unsigned char *>(std::malloc(BLOCK_HEADER_SIZE + size));
+    if (block == nullptr)
+    {
+        return nullptr;
+    }
+    size_t countedSize = 0;
+    if (accountingEnabled.load(std::memory_order_relaxed))
+    {
+        countedSize = size;
+        recordAllocation(size);
+    }
+    *reinterpret_cast<size_t *>(block) = countedSize;
+    return block + BLOCK_HEADER_SIZE;
+}
+
+static void freeBlock(void *p)
+{
+    if (p == nullptr)
+    {
+        return;
+    }
+    unsigned char *block = static_cast<unsigned char *>(p) - BLOCK_HEADER_SIZE;
+    size_t countedSize = *reinterpret_cast<size_t *>(block);
+    if (countedSize > 0)
+    {
+        recordFree(countedSize);
+    }
+    std::free(block);
+}
+
+void *operator new(size_t size)
+{
+    void *p = allocateBlock(size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocateBlock(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocateBlock(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    freeBlock(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    operator delete(p);
+}
+
+// Counts Mat buffers of the allocator it replaces as the default one
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+    explicit CountingMatAllocator(cv::MatAllocator *counted)
+        : counted(counted)
+    {
+    }
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data0, size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        cv::UMatData *u = counted->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        if (u != nullptr && data0 == nullptr)
+        {
+            // Releases come back here through the UMatData
+            u->currAllocator = u->prevAllocator = this;
+            recordAllocation(u->size);
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData *u, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return counted->allocate(u, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *u) const override
+    {
+        if (u == nullptr)
+        {
+            return;
+        }
+        recordFree(u->size);
+        u->currAllocator = u->prevAllocator = counted;
+        counted->deallocate(u);
+    }
+
+private:
+    cv::MatAllocator *counted;
+};
+
+int64_t getResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return static_cast<int64_t>(counters.WorkingSetSize);
+#else
+    // Second field of statm is resident pages
+    std::ifstream statm("/proc/self/statm");
+    int64_t totalPages = 0;
+    int64_t residentPages = 0;
+    if (!(statm >> totalPages >> residentPages))
+    {
+        return 0;
+    }
+    return residentPages * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+int64_t getPeakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return static_cast<int64_t>(counters.PeakWorkingSetSize);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+MemorySnapshot getMemorySnapshot()
+{
+    MemorySnapshot snapshot;
+    snapshot.Allocations = allocations.load();
+    snapshot.AllocatedBytes = allocatedBytes.load();
+    snapshot.LiveBytes = liveBytes.load();
+    snapshot.PeakLiveBytes = peakLiveBytes.load();
+    snapshot.ResidentBytes = getResidentBytes();
+    snapshot.PeakResidentBytes = getPeakResidentBytes();
+    return snapshot;
+}
+
+static void reportAtExit()
+{
+    printMemoryStages();
+    if (!reportJsonFile.empty())
+    {
+        writeMemoryStagesJson(reportJsonFile);
+    }
+}
+
+void enableMemoryAccounting(const std::string jsonFile)
+{
+    static std::once_flag enabled;
+    std::call_once(enabled, [&]()
+    {
+        // Lives until the process exits, Mats may be released from static destructors
+        static CountingMatAllocator allocator(cv::Mat::getDefaultAllocator());
+        cv::Mat::setDefaultAllocator(&allocator);
+        reportJsonFile = jsonFile;
+        accountingEnabled = true;
+        std::atexit(reportAtExit);
+    });
+}
+
+bool isMemoryAccountingEnabled()
+{
+    return accountingEnabled;
+}
+
+std::vector<StageMemory> getMemoryStages()
+{
+    std::lock_guard<std::mutex> lock(stagesMutex);
+    return stages;
+}
+
+static double toMegabytes(int64_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+void printMemoryStages()
+{
+    std::vector<StageMemory> recorded = getMemoryStages();
+    if (recorded.empty())
+    {
+        return;
+    }
+
+    std::cout << "Memory by stage:" << std::endl;
+    for (const StageMemory &stage : recorded)
+    {
+        std::cout << std::string(2 + 2 * stage.Depth, ' ') << stage.Name << ": " << stage.Allocations << " allocations, "
+                  << toMegabytes(stage.AllocatedBytes) << " MB allocated, peak live " << toMegabytes(stage.PeakLiveBytes)
+                  << " MB, left " << toMegabytes(stage.LiveBytesDelta) << " MB, RSS " << toMegabytes(stage.ResidentBytes)
+                  << " MB (peak " << toMegabytes(stage.PeakResidentBytes) << " MB), " << stage.Milliseconds << " ms" << std::endl;
+    }
+}
+
+static std::string escapeJson(const std::string &text)
+{
+    std::string result;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result;
+}
+
+int writeMemoryStagesJson(const std::string file)
+{
+    std::ofstream f(file);
+    if (!f.is_open())
+    {
+        std::cout << "Can't write memory report " << file << std::endl;
+        return 1;
+    }
+
+    std::vector<StageMemory> recorded = getMemoryStages();
+    f << "{\"stages\": [";
+    for (int i = 0; i < recorded.size(); i++)
+    {
+        const StageMemory &stage = recorded[i];
+        f << (i > 0 ? "," : "") << "\n  {\"name\": \"" << escapeJson(stage.Name) << "\", \"depth\": " << stage.Depth
+          << ", \"allocations\": " << stage.Allocations << ", \"allocatedBytes\": " << stage.AllocatedBytes
+          << ", \"peakLiveBytes\": " << stage.PeakLiveBytes << ", \"liveBytesDelta\": " << stage.LiveBytesDelta
+          << ", \"residentBytes\": " << stage.ResidentBytes << ", \"peakResidentBytes\": " << stage.PeakResidentBytes
+          << ", \"milliseconds\": " << stage.Milliseconds << "}";
+    }
+    f << "\n]}" << std::endl;
+    return f.fail() ? 1 : 0;
+}
+
+MemoryStage::MemoryStage(const std::string name)
+    : isActive(accountingEnabled)
+{
+    if (!isActive)
+    {
+        return;
+    }
+
+    stage.Name = name;
+    {
+        std::lock_guard<std::mutex> lock(stagesMutex);
+        stage.Depth = stageDepth++;
+    }
+    start = getMemorySnapshot();
+    // The peak restarts for this stage and is merged back into the outer one at the end
+    outerPeakLiveBytes = peakLiveBytes.exchange(start.LiveBytes);
+    startTicks = cv::getTickCount();
+}
+
+MemoryStage::~MemoryStage()
+{
+    stop();
+}
+
+void MemoryStage::stop()
+{
+    if (!isActive)
+    {
+        return;
+    }
+    isActive = false;
+
+    MemorySnapshot end = getMemorySnapshot();
+    stage.Allocations = end.Allocations - start.Allocations;
+    stage.AllocatedBytes = end.AllocatedBytes - start.AllocatedBytes;
+    stage.PeakLiveBytes = end.PeakLiveBytes;
+    stage.LiveBytesDelta = end.LiveBytes - start.LiveBytes;
+    stage.ResidentBytes = end.ResidentBytes;
+    stage.PeakResidentBytes = end.PeakResidentBytes;
+    stage.Milliseconds = (cv::getTickCount() - startTicks) * 1000.0 / cv::getTickFrequency();
+
+    int64_t peak = peakLiveBytes.load();
+    while (outerPeakLiveBytes > peak && !peakLiveBytes.compare_exchange_weak(peak, outerPeakLiveBytes))
+    {
+    }
+
+    std::lock_guard<std::mutex> lock(stagesMutex);
+    stageDepth--;
+    stages.push_back(stage);
+}
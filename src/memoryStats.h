@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Process-wide heap counters. Every operator new and every cv::Mat buffer is
+// counted once accounting is enabled, from all threads.
+struct MemorySnapshot
+{
+    int64_t Allocations;
+    int64_t AllocatedBytes;
+    int64_t LiveBytes;
+    int64_t PeakLiveBytes;
+    int64_t ResidentBytes;     // RSS of the process
+    int64_t PeakResidentBytes; // Largest RSS so far, as reported by the OS
+};
+
+// Counters of a pipeline stage between its start and end
+struct StageMemory
+{
+    std::string Name;
+    int Depth; // Nesting level of the stage
+    int64_t Allocations;
+    int64_t AllocatedBytes;
+    int64_t PeakLiveBytes;  // Live bytes of the whole process at the peak of the stage
+    int64_t LiveBytesDelta; // Bytes the stage left allocated
+    int64_t ResidentBytes;
+    int64_t PeakResidentBytes;
+    double Milliseconds;
+};
+
+// Starts counting operator new and cv::Mat buffers. Blocks allocated before
+// aren't counted, and neither are their frees. The report is printed at exit and also written to jsonFile unless it's empty.
+void enableMemoryAccounting(const std::string jsonFile);
+bool isMemoryAccountingEnabled();
+
+// Buffers taken from the heap outside of operator new and cv::Mat::create.
+// Callers count a buffer only while accounting is enabled and then count its free.
+void recordAllocation(size_t bytes);
+void recordFree(size_t bytes);
+
+MemorySnapshot getMemorySnapshot();
+int64_t getResidentBytes();
+int64_t getPeakResidentBytes();
+
+// Stages recorded so far in the order they ended
+std::vector<StageMemory> getMemoryStages();
+void printMemoryStages();
+int writeMemoryStagesJson(const std::string file);
+
+// Records the stage from construction to destruction while accounting is enabled.
+// Stages are process-wide, so they should follow the pipeline, not single threads.
+class MemoryStage
+{
+public:
+    explicit MemoryStage(const std::string name);
+    ~MemoryStage();
+
+    // Ends the stage before the scope does
+    void stop();
+
+    MemoryStage(const MemoryStage &) = delete;
+    MemoryStage &operator=(const MemoryStage &) = delete;
+
+private:
+    bool isActive;
+    StageMemory stage;
+    MemorySnapshot start;
+    int64_t outerPeakLiveBytes;
+    int64_t startTicks;
+};
@@ -0,0 +1,119 @@
+#include "prefetcher.h"
+#include <chrono>
+#include <iostream>
+
+typedef std::chrono::steady_clock Clock;
+
+static long long microsecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+ImagePrefetcher::ImagePrefetcher(const ImageSource &images, const std::vector<std::string> &imageFiles, int ioThreadsCount, size_t byteBudget)
+    : images(images),
+      imageFiles(imageFiles),
+      byteBudget(byteBudget),
+      slots(imageFiles.size()),
+      isReady(imageFiles.size(), false),
+      nextToRead(0),
+      nextToTake(0),
+      bufferedBytes(0),
+      isStopping(false),
+      readBytes(0),
+      waitMicroseconds(0),
+      decodeMicroseconds(0)
+{
+    for (int i = 0; i < std::max(ioThreadsCount, 1); i++)
+    {
+        ioThreads.push_back(std::thread(&ImagePrefetcher::readLoop, this));
+    }
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    budgetChanged.notify_all();
+    for (int i = 0; i < ioThreads.size(); i++)
+    {
+        ioThreads[i].join();
+    }
+}
+
+bool ImagePrefetcher::next(PrefetchedImage &image)
+{
+    Clock::time_point waitStart = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    if (nextToTake >= slots.size())
+    {
+        return false;
+    }
+
+    size_t index = nextToTake;
+    readyChanged.wait(lock, [&]
+                      { return isReady[index]; });
+    waitMicroseconds += microsecondsSince(waitStart);
+
+    image = std::move(slots[index]);
+    slots[index] = PrefetchedImage();
+    nextToTake++;
+    bufferedBytes -= image.Encoded.total();
+    budgetChanged.notify_all();
+    return true;
+}
+
+int ImagePrefetcher::decode(const PrefetchedImage &image, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color)
+{
+    if (image.Encoded.empty())
+    {
+        return 1;
+    }
+
+    Clock::time_point decodeStart = Clock::now();
+    int status = decodeImage(image.Encoded, policy, withColor, grayscale, color);
+    decodeMicroseconds += microsecondsSince(decodeStart);
+    return status;
+}
+
+void ImagePrefetcher::printStats() const
+{
+    std::cout << "Prefetched     : " << nextToTake << " images, " << readBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    std::cout << "I/O wait ms    : " << waitMicroseconds / 1000.0 << std::endl;
+    std::cout << "Decode ms      : " << decodeMicroseconds / 1000.0 << std::endl;
+}
+
+void ImagePrefetcher::readLoop()
+{
+    while (true)
+    {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // Images are claimed in order, so the one the consumer waits for is never
+            // stuck behind the budget: everything buffered before it was already taken
+            budgetChanged.wait(lock, [&]
+                               { return isStopping || nextToRead >= slots.size() ||
+                                        bufferedBytes == 0 || bufferedBytes < byteBudget; });
+            if (isStopping || nextToRead >= slots.size())
+            {
+                return;
+            }
+            index = nextToRead++;
+        }
+
+        PrefetchedImage image;
+        image.ImageFile = imageFiles[index];
+        images.readEncoded(image.ImageFile, image.Encoded);
+        readBytes += image.Encoded.total();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bufferedBytes += image.Encoded.total();
+            slots[index] = std::move(image);
+            isReady[index] = true;
+        }
+        readyChanged.notify_all();
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "imageSource.h"
+
+struct PrefetchedImage
+{
+    std::string ImageFile;
+    cv::Mat Encoded; // Raw file bytes as a single row, empty if the read failed
+};
+
+// Reads encoded images ahead of the consumer on I/O threads, in the order of
+// the given list, holding at most byteBudget bytes that were not taken yet.
+class ImagePrefetcher
+{
+public:
+    ImagePrefetcher(const ImageSource &images, const std::vector<std::string> &imageFiles, int ioThreadsCount, size_t byteBudget);
+    ~ImagePrefetcher();
+
+    // Waits for the next image, returns false after the last one
+    bool next(PrefetchedImage &image);
+
+    // Decodes a prefetched image, may be called from several threads
+    int decode(const PrefetchedImage &image, DecodePolicy policy, bool withColor, cv::Mat &grayscale, cv::Mat &color);
+
+    void printStats() const;
+
+private:
+    void readLoop();
+
+    const ImageSource &images;
+    std::vector<std::string> imageFiles;
+    size_t byteBudget;
+
+    std::mutex mutex;
+    std::condition_variable readyChanged;
+    std::condition_variable budgetChanged;
+    std::vector<PrefetchedImage> slots;
+    std::vector<bool> isReady;
+    size_t nextToRead;
+    size_t nextToTake;
+    size_t bufferedBytes;
+    bool isStopping;
+    std::vector<std::thread> ioThreads;
+
+    std::atomic<long long> readBytes;
+    std::atomic<long long> waitMicroseconds;
+    std::atomic<long long> decodeMicroseconds;
+};
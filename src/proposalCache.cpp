@@ -0,0 +1,241 @@
+#include "proposalCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// File layout: header, then count entries of a key, the time, the boxes count and the boxes
+static const char PROPOSAL_CACHE_MAGIC[8] = {'P', 'P', 'L', 'P', 'R', 'O', 'P', 'S'};
+static const uint32_t PROPOSAL_CACHE_VERSION = 1;
+
+struct ProposalCacheHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Reserved;
+    uint64_t ParamsHash;
+    uint64_t Count;
+};
+
+struct ProposalCacheEntryHeader
+{
+    uint64_t Key;
+    uint32_t Microseconds;
+    uint32_t BoxesCount;
+};
+
+static uint64_t mixHash(uint64_t hash, uint64_t value)
+{
+    hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+    return hash ^ (hash >> 31);
+}
+
+static uint64_t hashBytes(const unsigned char *data, size_t size)
+{
+    // Eight bytes per step, the tail is padded with zeros
+    uint64_t hash = mixHash(0xCBF29CE484222325ull, size);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001B3ull;
+        hash ^= hash >> 29;
+    }
+    uint64_t tail = 0;
+    if (i < size)
+    {
+        std::memcpy(&tail, data + i, size - i);
+    }
+    return mixHash(hash, tail);
+}
+
+// Everything findBoxesOnBlackBackground depends on besides the image
+static uint64_t getProposalParamsHash()
+{
+    uint64_t hash = mixHash(0, PROPOSAL_CACHE_VERSION);
+    hash = mixHash(hash, PROPOSAL_BLUR_SIZE);
+    return mixHash(hash, PROPOSAL_THRESHOLD);
+}
+
+uint64_t getProposalKeyOfBytes(const cv::Mat &encoded, DecodePolicy policy)
+{
+    return mixHash(hashBytes(encoded.ptr<unsigned char>(), encoded.total() * encoded.elemSize()), policy);
+}
+
+ProposalCache::ProposalCache()
+    : isDirty(false), hits(0), misses(0), savedMicroseconds(0), computedMicroseconds(0)
+{
+}
+
+int ProposalCache::open(const std::string file)
+{
+    this->file = file;
+    entries.clear();
+    isDirty = false;
+    if (file.empty())
+    {
+        return 0;
+    }
+
+    std::ifstream f(file, std::ios::binary);
+    if (!f.is_open())
+    {
+        return 0;
+    }
+
+    // The cache is derived data, a damaged one is rebuilt rather than stopping the command
+    f.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(f.tellg());
+    f.seekg(0, std::ios::beg);
+
+    ProposalCacheHeader header;
+    f.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (f.fail() || std::memcmp(header.Magic, PROPOSAL_CACHE_MAGIC, sizeof(header.Magic)) != 0)
+    {
+        std::cout << "Not a proposal cache " << file << ", the proposal cache starts over" << std::endl;
+        isDirty = true;
+        return 0;
+    }
+    if (header.Version != PROPOSAL_CACHE_VERSION || header.ParamsHash != getProposalParamsHash())
+    {
+        std::cout << "Proposal parameters changed, the proposal cache starts over" << std::endl;
+        isDirty = true;
+        return 0;
+    }
+
+    entries.reserve(std::min<uint64_t>(header.Count, fileSize / sizeof(ProposalCacheEntryHeader)));
+    std::vector<int32_t> coordinates;
+    for (uint64_t i = 0; i < header.Count; i++)
+    {
+        ProposalCacheEntryHeader entryHeader;
+        f.read(reinterpret_cast<char *>(&entryHeader), sizeof(entryHeader));
+        bool isTruncated = f.fail() || entryHeader.BoxesCount > fileSize / (4 * sizeof(int32_t));
+        if (!isTruncated)
+        {
+            coordinates.resize(entryHeader.BoxesCount * 4);
+            f.read(reinterpret_cast<char *>(coordinates.data()), coordinates.size() * sizeof(int32_t));
+            isTruncated = f.fail();
+        }
+        if (isTruncated)
+        {
+            std::cout << "Proposal cache " << file << " is truncated, the proposal cache starts over" << std::endl;
+            entries.clear();
+            isDirty = true;
+            return 0;
+        }
+
+        Entry &entry = entries[entryHeader.Key];
+        entry.Microseconds = entryHeader.Microseconds;
+        entry.Boxes.resize(entryHeader.BoxesCount);
+        for (uint32_t b = 0; b < entryHeader.BoxesCount; b++)
+        {
+            entry.Boxes[b] = cv::Rect(coordinates[b * 4], coordinates[b * 4 + 1], coordinates[b * 4 + 2], coordinates[b * 4 + 3]);
+        }
+    }
+    return 0;
+}
+
+std::vector<cv::Rect> ProposalCache::findBoxes(uint64_t key, const cv::Mat &grayscaleImage)
+{
+    if (file.empty())
+    {
+        return findBoxesOnBlackBackground(grayscaleImage);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(key);
+        if (found != entries.end())
+        {
+            hits++;
+            savedMicroseconds += found->second.Microseconds;
+            return found->second.Boxes;
+        }
+    }
+
+    int64_t start = cv::getTickCount();
+    Entry entry;
+    entry.Boxes = findBoxesOnBlackBackground(grayscaleImage);
+    entry.Microseconds = static_cast<uint32_t>((cv::getTickCount() - start) * 1e6 / cv::getTickFrequency());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    misses++;
+    computedMicroseconds += entry.Microseconds;
+    entries[key] = entry;
+    isDirty = true;
+    return entry.Boxes;
+}
+
+int ProposalCache::save()
+{
+    if (file.empty() || !isDirty)
+    {
+        return 0;
+    }
+
+    // Written next to the old file and renamed, so an interrupted run keeps the old one
+    std::string temporaryFile = file + ".tmp";
+    std::ofstream f(temporaryFile, std::ios::binary);
+    if (!f.is_open())
+    {
+        std::cout << "Can't save proposal cache " << file << std::endl;
+        return 1;
+    }
+
+    ProposalCacheHeader header;
+    std::memcpy(header.Magic, PROPOSAL_CACHE_MAGIC, sizeof(header.Magic));
+    header.Version = PROPOSAL_CACHE_VERSION;
+    header.Reserved = 0;
+    header.ParamsHash = getProposalParamsHash();
+    header.Count = entries.size();
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<int32_t> coordinates;
+    for (const auto &keyEntry : entries)
+    {
+        const std::vector<cv::Rect> &boxes = keyEntry.second.Boxes;
+        ProposalCacheEntryHeader entryHeader;
+        entryHeader.Key = keyEntry.first;
+        entryHeader.Microseconds = keyEntry.second.Microseconds;
+        entryHeader.BoxesCount = static_cast<uint32_t>(boxes.size());
+        coordinates.clear();
+        for (const cv::Rect &box : boxes)
+        {
+            coordinates.insert(coordinates.end(), {box.x, box.y, box.width, box.height});
+        }
+        f.write(reinterpret_cast<const char *>(&entryHeader), sizeof(entryHeader));
+        f.write(reinterpret_cast<const char *>(coordinates.data()), coordinates.size() * sizeof(int32_t));
+    }
+    f.close();
+    if (f.fail())
+    {
+        std::cout << "Can't save proposal cache " << file << std::endl;
+        return 1;
+    }
+
+    std::remove(file.c_str());
+    if (std::rename(temporaryFile.c_str(), file.c_str()) != 0)
+    {
+        std::cout << "Can't save proposal cache " << file << std::endl;
+        return 1;
+    }
+    isDirty = false;
+    return 0;
+}
+
+void ProposalCache::printStats() const
+{
+    if (file.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t lookups = hits + misses;
+    std::cout << "Proposal cache: " << hits << " hits of " << lookups << " images ("
+              << (lookups > 0 ? 100.0 * hits / lookups : 0) << "%), saved " << savedMicroseconds / 1000.0
+              << " ms, computed " << misses << " in " << computedMicroseconds / 1000.0 << " ms" << std::endl;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "imageUtils.h"
+
+// Keys of an image's proposals. The decode policy is part of the key since
+// color and grayscale decodes may differ slightly in gray levels.
+uint64_t getProposalKeyOfBytes(const cv::Mat &encoded, DecodePolicy policy);
+
+// Boxes of findBoxesOnBlackBackground kept between runs in a binary file.
+// The file is dropped when proposal parameters change. Lookups may come
+// from several threads.
+class ProposalCache
+{
+public:
+    ProposalCache();
+
+    // An empty file name disables the cache, a missing or damaged file starts an empty one
+    int open(const std::string file);
+
+    // Proposals of the image from the cache, found and added on a miss
+    std::vector<cv::Rect> findBoxes(uint64_t key, const cv::Mat &grayscaleImage);
+
+    // Writes the file if new proposals were added
+    int save();
+
+    void printStats() const;
+
+private:
+    struct Entry
+    {
+        std::vector<cv::Rect> Boxes;
+        uint32_t Microseconds; // Time it took to find the boxes
+    };
+
+    std::string file;
+    std::unordered_map<uint64_t, Entry> entries;
+    mutable std::mutex mutex;
+    bool isDirty;
+    int64_t hits;
+    int64_t misses;
+    int64_t savedMicroseconds;
+    int64_t computedMicroseconds;
+};
@@ -0,0 +1,196 @@
+#include "quantization.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Quantized values are symmetric, -128 is never used
+const int INT8_LEVELS = 127;
+// Windows scored near the threshold are likely to differ from the calibration ones
+const float ERROR_MARGIN_FACTOR = 2.0f;
+
+int getHogBlockLength(const cv::HOGDescriptor &hog)
+{
+    int cellsPerBlock = (hog.blockSize.width / hog.cellSize.width) * (hog.blockSize.height / hog.cellSize.height);
+    return cellsPerBlock * hog.nbins;
+}
+
+static float quantizeBlock(const float *values, int count, schar *result)
+{
+    float maxValue = 0;
+    for (int i = 0; i < count; i++)
+    {
+        maxValue = std::max(maxValue, std::abs(values[i]));
+    }
+    if (maxValue == 0)
+    {
+        std::fill(result, result + count, 0);
+        return 0;
+    }
+
+    float scale = maxValue / INT8_LEVELS;
+    float inverseScale = 1 / scale;
+    for (int i = 0; i < count; i++)
+    {
+        int value = cvRound(values[i] * inverseScale);
+        result[i] = static_cast<schar>(std::min(std::max(value, -INT8_LEVELS), INT8_LEVELS));
+    }
+    return scale;
+}
+
+void quantizeDescriptors(const cv::Mat &samples, int blockLength, QuantizedDescriptors &result)
+{
+    CV_Assert(samples.type() == CV_32F && samples.cols % blockLength == 0);
+    int blocksCount = samples.cols / blockLength;
+    result.Values.create(samples.rows, samples.cols, CV_8S);
+    result.Scales.create(samples.rows, blocksCount, CV_32F);
+    for (int row = 0; row < samples.rows; row++)
+    {
+        const float *values = samples.ptr<float>(row);
+        schar *quantized = result.Values.ptr<schar>(row);
+        float *scales = result.Scales.ptr<float>(row);
+        for (int block = 0; block < blocksCount; block++)
+        {
+            int offset = block * blockLength;
+            scales[block] = quantizeBlock(values + offset, blockLength, quantized + offset);
+        }
+    }
+}
+
+static int dotInt8(const schar *a, const schar *b, int count)
+{
+    int i = 0;
+    int sum = 0;
+#if CV_SIMD128
+    // Pairs of int8 products are summed in int16, then pairs of those in int32
+    cv::v_int32x4 acc = cv::v_setzero_s32();
+    for (; i <= count - cv::v_int8x16::nlanes; i += cv::v_int8x16::nlanes)
+    {
+        acc = cv::v_dotprod_expand(cv::v_load(a + i), cv::v_load(b + i), acc);
+    }
+    sum = cv::v_reduce_sum(acc);
+#endif
+    for (; i < count; i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+QuantizedLinearModel::QuantizedLinearModel()
+    : blockLength(0), bias(0), weightScale(0), errorMargin(0), maxError(0), meanError(0)
+{
+}
+
+void QuantizedLinearModel::create(const cv::Mat &weights, float bias, int blockLength)
+{
+    CV_Assert(weights.rows == 1 && weights.type() == CV_32F && weights.cols % blockLength == 0);
+    this->weights = weights;
+    this->bias = bias;
+    this->blockLength = blockLength;
+    errorMargin = 0;
+    maxError = 0;
+    meanError = 0;
+
+    quantizedWeights.create(1, weights.cols, CV_8S);
+    weightScale = quantizeBlock(weights.ptr<float>(), weights.cols, quantizedWeights.ptr<schar>());
+}
+
+bool QuantizedLinearModel::empty() const
+{
+    return quantizedWeights.empty();
+}
+
+void QuantizedLinearModel::scoreQuantized(const QuantizedDescriptors &samples, std::vector<float> &scores) const
+{
+    int blocksCount = samples.Values.cols / blockLength;
+    const schar *w = quantizedWeights.ptr<schar>();
+    scores.resize(samples.Values.rows);
+    for (int row = 0; row < samples.Values.rows; row++)
+    {
+        const schar *values = samples.Values.ptr<schar>(row);
+        const float *scales = samples.Scales.ptr<float>(row);
+        float sum = 0;
+        for (int block = 0; block < blocksCount; block++)
+        {
+            int offset = block * blockLength;
+            sum += scales[block] * dotInt8(values + offset, w + offset, blockLength);
+        }
+        scores[row] = bias + weightScale * sum;
+    }
+}
+
+void QuantizedLinearModel::calibrate(const cv::Mat &samples)
+{
+    QuantizedDescriptors quantized;
+    quantizeDescriptors(samples, blockLength, quantized);
+    std::vector<float> scores;
+    scoreQuantized(quantized, scores);
+
+    double errorsSum = 0;
+    maxError = 0;
+    for (int row = 0; row < samples.rows; row++)
+    {
+        float error = std::abs(scores[row] - static_cast<float>(samples.row(row).dot(weights) + bias));
+        maxError = std::max(maxError, error);
+        errorsSum += error;
+    }
+    meanError = samples.rows > 0 ? static_cast<float>(errorsSum / samples.rows) : 0;
+    errorMargin = maxError * ERROR_MARGIN_FACTOR;
+    std::cout << "Int8 scores on " << samples.rows << " windows: mean error " << meanError
+              << ", max error " << maxError << std::endl;
+}
+
+float QuantizedLinearModel::getErrorMargin() const
+{
+    return errorMargin;
+}
+
+void QuantizedLinearModel::score(const cv::Mat &samples, float threshold, std::vector<float> &scores) const
+{
+    QuantizedDescriptors quantized;
+    quantizeDescriptors(samples, blockLength, quantized);
+    scoreQuantized(quantized, scores);
+
+    for (int row = 0; row < samples.rows; row++)
+    {
+        if (std::abs(scores[row] - threshold) <= errorMargin)
+        {
+            scores[row] = static_cast<float>(samples.row(row).dot(weights) + bias);
+        }
+    }
+}
+
+int QuantizedLinearModel::appendTo(const std::string modelFile) const
+{
+    cv::FileStorage fs(modelFile, cv::FileStorage::APPEND);
+    if (!fs.isOpened())
+    {
+        std::cout << "Can't open classifier " << modelFile << " to add the int8 calibration" << std::endl;
+        return 1;
+    }
+    fs << "people_int8" << "{";
+    fs << "blockLength" << blockLength;
+    fs << "errorMargin" << errorMargin;
+    fs << "maxError" << maxError;
+    fs << "meanError" << meanError;
+    fs << "}";
+    return 0;
+}
+
+bool QuantizedLinearModel::read(const cv::FileStorage &fs, const cv::Mat &weights, float bias)
+{
+    cv::FileNode node = fs["people_int8"];
+    int storedBlockLength = node.empty() ? 0 : static_cast<int>(node["blockLength"]);
+    if (storedBlockLength <= 0 || weights.empty() || weights.cols % storedBlockLength != 0)
+    {
+        quantizedWeights.release();
+        return false;
+    }
+
+    create(weights, bias, storedBlockLength);
+    errorMargin = node["errorMargin"];
+    maxError = node["maxError"];
+    meanError = node["meanError"];
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+// Values of a HOG block, bins of all its cells
+int getHogBlockLength(const cv::HOGDescriptor &hog);
+
+// Int8 copies of descriptors in rows. Every block has its own scale, L2Hys
+// normalization keeps the values of a block in a narrow range.
+struct QuantizedDescriptors
+{
+    cv::Mat Values; // CV_8S, a descriptor per row
+    cv::Mat Scales; // CV_32F, a scale per block of every row
+};
+
+void quantizeDescriptors(const cv::Mat &samples, int blockLength, QuantizedDescriptors &result);
+
+// Linear decision function scored on int8 descriptors. Scores closer to the
+// threshold than the calibrated error margin are recomputed in float, so
+// decisions match the float classifier on windows like the calibration ones.
+class QuantizedLinearModel
+{
+public:
+    QuantizedLinearModel();
+
+    void create(const cv::Mat &weights, float bias, int blockLength);
+    bool empty() const;
+
+    // Sets the error margin from the largest difference between int8 and float scores
+    void calibrate(const cv::Mat &samples);
+    float getErrorMargin() const;
+
+    void score(const cv::Mat &samples, float threshold, std::vector<float> &scores) const;
+
+    // Calibration is stored in the model file, weights are quantized again on load
+    int appendTo(const std::string modelFile) const;
+    // Returns false if the model file wasn't calibrated
+    bool read(const cv::FileStorage &fs, const cv::Mat &weights, float bias);
+
+private:
+    int blockLength;
+    cv::Mat weights; // Float weights for scores near the threshold
+    float bias;
+    cv::Mat quantizedWeights;
+    float weightScale;
+    float errorMargin;
+    float maxError;
+    float meanError;
+
+    void scoreQuantized(const QuantizedDescriptors &samples, std::vector<float> &scores) const;
+};
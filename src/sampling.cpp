@@ -0,0 +1,125 @@
+#include "sampling.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+
+// Images with this many people or more share the last stratum
+const int MAX_STRATUM = 4;
+
+int readSampleOptions(const cv::FileStorage &params, SampleOptions &options)
+{
+    options.Seed = params["sampleRngSeed"];
+    options.SplitRatio = params["sampleSplitRatio"];
+    options.FoldsCount = params["sampleFolds"];
+    options.FoldIndex = params["sampleFold"];
+    options.Stratify = static_cast<int>(params["sampleStratify"]) != 0;
+    // Otherwise the validation range is empty or wraps and every image is trained on
+    if (options.FoldsCount > 1 && (options.FoldIndex < 0 || options.FoldIndex >= options.FoldsCount))
+    {
+        std::cout << "sampleFold " << options.FoldIndex << " is out of range for " << options.FoldsCount << " folds" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+std::vector<int> countAnnotationsPerImage(
+    const std::vector<std::string> &fullSet,
+    const std::vector<ImageAnnotation> &annotations)
+{
+    std::unordered_map<std::string, int> counts;
+    for (int i = 0; i < annotations.size(); i++)
+    {
+        counts[annotations[i].FileName]++;
+    }
+
+    std::vector<int> result(fullSet.size(), 0);
+    for (int i = 0; i < fullSet.size(); i++)
+    {
+        auto found = counts.find(fullSet[i]);
+        if (found != counts.end())
+        {
+            result[i] = found->second;
+        }
+    }
+    return result;
+}
+
+// Moves a uniformly random choice of count elements to the front
+static void partialShuffle(std::vector<int> &indices, size_t count, cv::RNG &rng)
+{
+    for (size_t i = 0; i < count && i + 1 < indices.size(); i++)
+    {
+        size_t j = i + rng.uniform(0, static_cast<int>(indices.size() - i));
+        std::swap(indices[i], indices[j]);
+    }
+}
+
+static void setBit(std::vector<uint64_t> &bits, int index)
+{
+    bits[index / 64] |= uint64_t(1) << (index % 64);
+}
+
+static bool getBit(const std::vector<uint64_t> &bits, int index)
+{
+    return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+std::vector<std::string> getTrainOrValidationSample(
+    const std::vector<std::string> &fullSet,
+    const std::vector<int> &annotationCounts,
+    const SampleOptions &options,
+    bool isTrainSample)
+{
+    int size = fullSet.size();
+    std::vector<std::vector<int>> strata(options.Stratify ? MAX_STRATUM + 1 : 1);
+    for (int i = 0; i < size; i++)
+    {
+        int stratum = 0;
+        if (options.Stratify && i < annotationCounts.size())
+        {
+            stratum = std::min(annotationCounts[i], MAX_STRATUM);
+        }
+        strata[stratum].push_back(i);
+    }
+
+    cv::RNG rng(options.Seed);
+    std::vector<uint64_t> trainBits((size + 63) / 64, 0);
+    for (int s = 0; s < strata.size(); s++)
+    {
+        std::vector<int> &indices = strata[s];
+        size_t stratumSize = indices.size();
+        if (options.FoldsCount > 1)
+        {
+            partialShuffle(indices, stratumSize, rng);
+            size_t validationBegin = stratumSize * options.FoldIndex / options.FoldsCount;
+            size_t validationEnd = stratumSize * (options.FoldIndex + 1) / options.FoldsCount;
+            for (size_t i = 0; i < stratumSize; i++)
+            {
+                if (i < validationBegin || i >= validationEnd)
+                {
+                    setBit(trainBits, indices[i]);
+                }
+            }
+        }
+        else
+        {
+            size_t trainSize = static_cast<size_t>(stratumSize * options.SplitRatio);
+            partialShuffle(indices, trainSize, rng);
+            for (size_t i = 0; i < trainSize; i++)
+            {
+                setBit(trainBits, indices[i]);
+            }
+        }
+    }
+
+    std::vector<std::string> result;
+    for (int i = 0; i < size; i++)
+    {
+        if (getBit(trainBits, i) == isTrainSample)
+        {
+            result.push_back(fullSet[i]);
+        }
+    }
+    return result;
+}
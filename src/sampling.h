@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "annotations.h"
+
+// How images are split into train and validation samples, see params.yml
+struct SampleOptions
+{
+    int Seed;
+    float SplitRatio;
+    int FoldsCount; // Less than 2 splits by SplitRatio instead of folds
+    int FoldIndex;  // Validation fold when splitting by folds
+    bool Stratify;  // Split every annotations count group on its own
+};
+
+// Fails on a fold index outside of the folds count
+int readSampleOptions(const cv::FileStorage &params, SampleOptions &options);
+
+// Number of annotated people on every image of the set
+std::vector<int> countAnnotationsPerImage(
+    const std::vector<std::string> &fullSet,
+    const std::vector<ImageAnnotation> &annotations);
+
+// Seeded partial Fisher-Yates shuffle over all indices. The result keeps
+// the order of the full set. annotationCounts is only used when stratifying.
+std::vector<std::string> getTrainOrValidationSample(
+    const std::vector<std::string> &fullSet,
+    const std::vector<int> &annotationCounts,
+    const SampleOptions &options,
+    bool isTrainSample);
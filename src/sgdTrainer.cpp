@@ -0,0 +1,382 @@
+#include "sgdTrainer.h"
+#include "detection.h"
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+// File layout: header, then count records of dims + 1 floats
+static const char DESCRIPTOR_FILE_MAGIC[8] = {'P', 'P', 'L', 'D', 'E', 'S', 'C', 'R'};
+static const uint32_t DESCRIPTOR_FILE_VERSION = 1;
+static const uint64_t FILTER_BLOCK_RECORDS = 4096;
+
+struct DescriptorFileHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Dims;
+    uint64_t Count;
+};
+
+int DescriptorWriter::open(const std::string file, int dims)
+{
+    this->file = file;
+    this->dims = dims;
+    count = 0;
+
+    f.open(file, std::ios::binary);
+    if (!f.is_open())
+    {
+        std::cout << "Can't open file to save descriptors " << file << std::endl;
+        return 1;
+    }
+
+    // The count is written once more on close
+    DescriptorFileHeader header;
+    std::memcpy(header.Magic, DESCRIPTOR_FILE_MAGIC, sizeof(header.Magic));
+    header.Version = DESCRIPTOR_FILE_VERSION;
+    header.Dims = dims;
+    header.Count = 0;
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    return f.fail() ? 1 : 0;
+}
+
+int DescriptorWriter::write(const float *descriptor, bool isPerson)
+{
+    float label = isPerson ? 1.0f : -1.0f;
+    f.write(reinterpret_cast<const char *>(descriptor), dims * sizeof(float));
+    f.write(reinterpret_cast<const char *>(&label), sizeof(label));
+    count++;
+    return f.fail() ? 1 : 0;
+}
+
+int DescriptorWriter::close()
+{
+    f.seekp(offsetof(DescriptorFileHeader, Count));
+    f.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    f.close();
+    if (f.fail())
+    {
+        std::cout << "Can't write descriptors file " << file << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int DescriptorFile::open(const std::string file)
+{
+    if (!mapping.open(file))
+    {
+        std::cout << "Can't open descriptors file " << file << std::endl;
+        return 1;
+    }
+
+    DescriptorFileHeader header;
+    if (mapping.size() < sizeof(header))
+    {
+        std::cout << "Not a descriptors file " << file << std::endl;
+        return 1;
+    }
+    std::memcpy(&header, mapping.data(), sizeof(header));
+    if (std::memcmp(header.Magic, DESCRIPTOR_FILE_MAGIC, sizeof(header.Magic)) != 0 || header.Version != DESCRIPTOR_FILE_VERSION)
+    {
+        std::cout << "Not a descriptors file " << file << std::endl;
+        return 1;
+    }
+
+    dims = header.Dims;
+    count = header.Count;
+    recordsOffset = sizeof(header);
+    if (dims == 0 || mapping.size() != recordsOffset + count * (dims + 1) * sizeof(float))
+    {
+        std::cout << "Truncated descriptors file " << file << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int DescriptorFile::getDims() const
+{
+    return dims;
+}
+
+uint64_t DescriptorFile::getCount() const
+{
+    return count;
+}
+
+const float *DescriptorFile::getRecords(uint64_t first) const
+{
+    return reinterpret_cast<const float *>(mapping.data() + recordsOffset) + first * (dims + 1);
+}
+
+void DescriptorFile::copySample(uint64_t maxCount, cv::Mat &samples) const
+{
+    samples.release();
+    uint64_t stride = std::max<uint64_t>(1, count / std::max<uint64_t>(1, maxCount));
+    for (uint64_t i = 0; i < count && static_cast<uint64_t>(samples.rows) < maxCount; i += stride)
+    {
+        // The label follows the descriptor, a 1 x dims header leaves it out
+        samples.push_back(cv::Mat(1, dims, CV_32F, const_cast<float *>(getRecords(i))));
+    }
+}
+
+void DescriptorFile::release(uint64_t first, uint64_t count) const
+{
+    size_t recordBytes = (dims + 1) * sizeof(float);
+    mapping.release(recordsOffset + first * recordBytes, count * recordBytes);
+}
+
+int filterDescriptorFile(
+    const std::string descriptorsFile,
+    const std::string keysFile,
+    uint64_t maxKey,
+    const std::string filteredFile,
+    uint64_t &keptCount)
+{
+    keptCount = 0;
+    DescriptorFile input;
+    if (input.open(descriptorsFile) != 0)
+    {
+        return 1;
+    }
+    std::ifstream keysStream(keysFile, std::ios::binary);
+    if (!keysStream.is_open())
+    {
+        std::cout << "Can't open keys file " << keysFile << std::endl;
+        return 1;
+    }
+
+    DescriptorWriter output;
+    if (output.open(filteredFile, input.getDims()) != 0)
+    {
+        return 1;
+    }
+
+    int dims = input.getDims();
+    std::vector<uint64_t> keys(FILTER_BLOCK_RECORDS);
+    for (uint64_t first = 0; first < input.getCount(); first += FILTER_BLOCK_RECORDS)
+    {
+        uint64_t blockCount = std::min(input.getCount() - first, FILTER_BLOCK_RECORDS);
+        keysStream.read(reinterpret_cast<char *>(keys.data()), blockCount * sizeof(uint64_t));
+        if (keysStream.gcount() != static_cast<std::streamsize>(blockCount * sizeof(uint64_t)))
+        {
+            std::cout << "Keys file " << keysFile << " doesn't match " << descriptorsFile << std::endl;
+            return 1;
+        }
+
+        const float *records = input.getRecords(first);
+        for (uint64_t i = 0; i < blockCount; i++)
+        {
+            if (keys[i] > maxKey)
+            {
+                continue;
+            }
+            const float *record = records + i * (dims + 1);
+            if (output.write(record, record[dims] > 0) != 0)
+            {
+                std::cout << "Can't write descriptors file " << filteredFile << std::endl;
+                return 1;
+            }
+            keptCount++;
+        }
+        input.release(first, blockCount);
+    }
+    return output.close();
+}
+
+SgdTrainer::SgdTrainer(int dims, double lambda)
+    : dims(dims),
+      lambda(lambda),
+      steps(0),
+      averagedSteps(0),
+      weights(dims + 1, 0),
+      averagedWeights(dims + 1, 0),
+      gradient(dims + 1, 0)
+{
+}
+
+void SgdTrainer::partialFit(const float *records, int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    std::fill(gradient.begin(), gradient.end(), 0);
+    for (int r = 0; r < count; r++)
+    {
+        const float *x = records + r * (dims + 1);
+        float y = x[dims];
+        double decision = weights[dims];
+        for (int i = 0; i < dims; i++)
+        {
+            decision += weights[i] * x[i];
+        }
+        if (y * decision >= 1)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < dims; i++)
+        {
+            gradient[i] += y * x[i];
+        }
+        gradient[dims] += y;
+    }
+
+    steps++;
+    double learningRate = 1.0 / (lambda * steps);
+    double shrink = 1.0 - learningRate * lambda;
+    double squaredNorm = 0;
+    for (int i = 0; i <= dims; i++)
+    {
+        weights[i] = shrink * weights[i] + learningRate / count * gradient[i];
+        squaredNorm += weights[i] * weights[i];
+    }
+
+    // The optimum lies within this ball, projecting keeps early steps from overshooting
+    double maxNorm = 1.0 / std::sqrt(lambda);
+    double scale = squaredNorm > maxNorm * maxNorm ? maxNorm / std::sqrt(squaredNorm) : 1.0;
+    averagedSteps++;
+    for (int i = 0; i <= dims; i++)
+    {
+        weights[i] *= scale;
+        averagedWeights[i] += (weights[i] - averagedWeights[i]) / averagedSteps;
+    }
+}
+
+void SgdTrainer::restartAverage()
+{
+    averagedSteps = 0;
+}
+
+void SgdTrainer::getModel(std::vector<float> &weights, float &bias) const
+{
+    weights.assign(averagedWeights.begin(), averagedWeights.begin() + dims);
+    bias = static_cast<float>(averagedWeights[dims]);
+}
+
+int checkSgdOptions(const SgdOptions &options)
+{
+    if (options.Epochs < 1)
+    {
+        std::cout << "SGD needs at least one epoch" << std::endl;
+        return 1;
+    }
+    if (options.BatchSize < 1)
+    {
+        std::cout << "SGD batch size must be positive" << std::endl;
+        return 1;
+    }
+    // Step sizes and the saved C divide by lambda
+    if (!(options.Lambda > 0))
+    {
+        std::cout << "SGD lambda must be positive" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int trainSgd(const std::string descriptorsFile, const SgdOptions &options, std::vector<float> &weights, float &bias)
+{
+    if (checkSgdOptions(options) != 0)
+    {
+        return 1;
+    }
+    DescriptorFile descriptors;
+    if (descriptors.open(descriptorsFile) != 0)
+    {
+        return 1;
+    }
+    if (descriptors.getCount() == 0)
+    {
+        std::cout << "No descriptors to train on in " << descriptorsFile << std::endl;
+        return 1;
+    }
+
+    uint64_t batchSize = options.BatchSize;
+    uint64_t batchesCount = (descriptors.getCount() + batchSize - 1) / batchSize;
+    std::vector<uint64_t> batches(batchesCount);
+    for (uint64_t i = 0; i < batchesCount; i++)
+    {
+        batches[i] = i;
+    }
+
+    SgdTrainer trainer(descriptors.getDims(), options.Lambda);
+    cv::RNG rng(options.Seed);
+    for (int epoch = 0; epoch < options.Epochs; epoch++)
+    {
+        // Whole batches are shuffled, so reads stay sequential within a batch
+        for (uint64_t i = batchesCount; i > 1; i--)
+        {
+            std::swap(batches[i - 1], batches[rng.uniform(0, static_cast<int>(std::min<uint64_t>(i, INT32_MAX)))]);
+        }
+
+        for (uint64_t i = 0; i < batchesCount; i++)
+        {
+            uint64_t first = batches[i] * batchSize;
+            uint64_t count = std::min(batchSize, descriptors.getCount() - first);
+            trainer.partialFit(descriptors.getRecords(first), static_cast<int>(count));
+            descriptors.release(first, count);
+        }
+        std::cout << "Epoch " << epoch + 1 << " of " << options.Epochs << " done" << std::endl;
+        if (epoch == 0)
+        {
+            // The first epoch moves far from the zero start, later ones are averaged
+            trainer.restartAverage();
+        }
+    }
+
+    trainer.getModel(weights, bias);
+    return 0;
+}
+
+int saveLinearSvm(const std::string file, const std::vector<float> &weights, float bias, double C)
+{
+    cv::FileStorage fs(file, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        std::cout << "Can't open file to save classifier " << file << std::endl;
+        return 1;
+    }
+
+    // People have the first label, which wins when alpha * sv . x - rho > 0
+    cv::Mat classLabels(2, 1, CV_32SC1);
+    classLabels.at<int>(0) = LABEL_PERSON;
+    classLabels.at<int>(1) = LABEL_BACKGROUND;
+    double alpha = 1;
+    double rho = -bias;
+    int index = 0;
+
+    fs << "opencv_ml_svm" << "{";
+    fs << "format" << 3;
+    fs << "svmType" << "C_SVC";
+    fs << "kernel" << "{" << "type" << "LINEAR" << "}";
+    fs << "C" << C;
+    fs << "term_criteria" << "{:" << "epsilon" << FLT_EPSILON << "iterations" << 1000 << "}";
+    fs << "var_count" << static_cast<int>(weights.size());
+    fs << "class_count" << 2;
+    fs << "class_labels" << classLabels;
+    fs << "sv_total" << 1;
+    fs << "support_vectors" << "[";
+    fs << "[:";
+    fs.writeRaw("f", weights.data(), weights.size() * sizeof(float));
+    fs << "]";
+    fs << "]";
+    fs << "decision_functions" << "[";
+    fs << "{" << "sv_count" << 1 << "rho" << rho << "alpha" << "[:";
+    fs.writeRaw("d", &alpha, sizeof(alpha));
+    fs << "]";
+    fs << "index" << "[:";
+    fs.writeRaw("i", &index, sizeof(index));
+    fs << "]";
+    fs << "}";
+    fs << "]";
+    fs << "}";
+    fs.release();
+    return 0;
+}
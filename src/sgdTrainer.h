@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "mappedFile.h"
+
+struct SgdOptions
+{
+    int Epochs;
+    int BatchSize;
+    double Lambda; // Regularization, comparable to 1 / (C * samples count)
+    int Seed;      // Order of mini-batches in every epoch
+};
+
+// Training records appended one by one to a binary file, so extraction never
+// holds more than a single descriptor. A record is the descriptor followed
+// by the label: +1 for people and -1 for background.
+class DescriptorWriter
+{
+public:
+    int open(const std::string file, int dims);
+    int write(const float *descriptor, bool isPerson);
+    int close();
+
+private:
+    std::ofstream f;
+    std::string file;
+    int dims;
+    uint64_t count;
+};
+
+// Records of a descriptor file mapped into memory
+class DescriptorFile
+{
+public:
+    int open(const std::string file);
+
+    int getDims() const;
+    uint64_t getCount() const;
+
+    // Records [first, first + count) lie one after another, dims + 1 floats each
+    const float *getRecords(uint64_t first) const;
+    // Descriptors of at most maxCount records evenly spread over the file, in rows
+    void copySample(uint64_t maxCount, cv::Mat &samples) const;
+    // Drops records from memory once a pass over them is done
+    void release(uint64_t first, uint64_t count) const;
+
+private:
+    MappedFile mapping;
+    int dims;
+    uint64_t count;
+    size_t recordsOffset;
+};
+
+// Copies records whose keys, one uint64 per record in keysFile, are at most maxKey.
+// Lets extraction write windows before the global background sample is known.
+int filterDescriptorFile(
+    const std::string descriptorsFile,
+    const std::string keysFile,
+    uint64_t maxKey,
+    const std::string filteredFile,
+    uint64_t &keptCount);
+
+// Pegasos on the hinge loss with the iterates averaged. The bias is an extra
+// weight of a constant feature, so memory only depends on the descriptor size.
+class SgdTrainer
+{
+public:
+    SgdTrainer(int dims, double lambda);
+
+    void partialFit(const float *records, int count);
+    // Forgets the early iterates, the average then starts from the current weights
+    void restartAverage();
+
+    // Averaged weights and bias, the decision is weights . x + bias
+    void getModel(std::vector<float> &weights, float &bias) const;
+
+private:
+    int dims;
+    double lambda;
+    int64_t steps;
+    int64_t averagedSteps;
+    std::vector<double> weights;
+    std::vector<double> averagedWeights;
+    std::vector<double> gradient;
+};
+
+// Prints the first option out of range, checked before extraction starts
+int checkSgdOptions(const SgdOptions &options);
+
+// Passes over the mapped file in shuffled mini-batches for every epoch
+int trainSgd(const std::string descriptorsFile, const SgdOptions &options, std::vector<float> &weights, float &bias);
+
+// Writes a linear SVM the way cv::ml::SVM::save does, so SVM::load reads it back
+int saveLinearSvm(const std::string file, const std::vector<float> &weights, float bias, double C);
@@ -0,0 +1,433 @@
+#include "sweep.h"
+#include "annotations.h"
+#include "arenaAllocator.h"
+#include "classifier.h"
+#include "detection.h"
+#include "evaluation.h"
+#include "extraction.h"
+#include "imageSource.h"
+#include "imageUtils.h"
+#include "prefetcher.h"
+#include "proposalCache.h"
+#include "sampling.h"
+#include <opencv2/ml.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+// Windows and descriptors of one image for every configuration
+struct SweepImage
+{
+    std::string ImageFile;
+    bool IsTrain;
+    std::vector<cv::Rect> Boxes;
+    ImageSamples Samples;             // Labels and keys of train windows
+    std::vector<cv::Mat> Descriptors; // One matrix per configuration, a window per row
+    std::vector<int64_t> HogTicks;    // Time of descriptors per configuration
+};
+
+struct SweepResult
+{
+    int TrainWindows;
+    double TrainMilliseconds;
+    double DetectMilliseconds;
+    EvaluationResult Evaluation;
+};
+
+static std::vector<int> readGridList(const cv::FileStorage &grid, const std::string key, int defaultValue)
+{
+    std::vector<int> values;
+    cv::FileNode node = grid[key];
+    if (node.isSeq())
+    {
+        for (auto it = node.begin(); it != node.end(); ++it)
+        {
+            values.push_back(static_cast<int>(*it));
+        }
+    }
+    else if (!node.empty())
+    {
+        values.push_back(static_cast<int>(node));
+    }
+    if (values.empty())
+    {
+        values.push_back(defaultValue);
+    }
+    return values;
+}
+
+static bool isValidConfig(const SweepConfig &config)
+{
+    return config.CellSize > 0 && config.BlockSize > 0 && config.BlockStride > 0 && config.Nbins > 0 &&
+           config.BlockSize % config.CellSize == 0 && config.BlockSize <= config.WindowSize &&
+           (config.WindowSize - config.BlockSize) % config.BlockStride == 0;
+}
+
+int readSweepGrid(const std::string gridFile, std::vector<SweepConfig> &configs)
+{
+    cv::FileStorage grid(gridFile, cv::FileStorage::READ);
+    if (!grid.isOpened())
+    {
+        std::cout << "Can't open sweep grid " << gridFile << std::endl;
+        return 1;
+    }
+
+    // Zero stride steps blocks by their size
+    std::vector<int> windowSizes = readGridList(grid, "windowSize", 128);
+    std::vector<int> blockSizes = readGridList(grid, "blockSize", 32);
+    std::vector<int> blockStrides = readGridList(grid, "blockStride", 0);
+    std::vector<int> cellSizes = readGridList(grid, "cellSize", 16);
+    std::vector<int> nbinsList = readGridList(grid, "nbins", 13);
+
+    configs.clear();
+    for (int windowSize : windowSizes)
+    {
+        for (int blockSize : blockSizes)
+        {
+            for (int blockStride : blockStrides)
+            {
+                for (int cellSize : cellSizes)
+                {
+                    for (int nbins : nbinsList)
+                    {
+                        SweepConfig config;
+                        config.WindowSize = windowSize;
+                        config.BlockSize = blockSize;
+                        config.BlockStride = blockStride > 0 ? blockStride : blockSize;
+                        config.CellSize = cellSize;
+                        config.Nbins = nbins;
+                        if (!isValidConfig(config))
+                        {
+                            std::cout << "Skipping window " << windowSize << ", block " << blockSize << ", stride "
+                                      << config.BlockStride << ", cell " << cellSize << std::endl;
+                            continue;
+                        }
+                        configs.push_back(config);
+                    }
+                }
+            }
+        }
+    }
+
+    if (configs.empty())
+    {
+        std::cout << "No valid configurations in " << gridFile << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void applySweepConfig(const SweepConfig &config, cv::HOGDescriptor &hog)
+{
+    hog.winSize = cv::Size(config.WindowSize, config.WindowSize);
+    hog.blockSize = cv::Size(config.BlockSize, config.BlockSize);
+    hog.blockStride = cv::Size(config.BlockStride, config.BlockStride);
+    hog.cellSize = cv::Size(config.CellSize, config.CellSize);
+    hog.nbins = config.Nbins;
+}
+
+// Resizes windows once per window size and computes descriptors of every configuration
+static void computeSweepDescriptors(
+    const cv::Mat &image,
+    const std::vector<cv::HOGDescriptor> &hogs,
+    const std::vector<int> &windowSizes,
+    SweepImage &result)
+{
+    int rows = static_cast<int>(result.Boxes.size());
+    result.Descriptors.resize(hogs.size());
+    result.HogTicks.assign(hogs.size(), 0);
+    for (int c = 0; c < hogs.size(); c++)
+    {
+        result.Descriptors[c].create(rows, static_cast<int>(hogs[c].getDescriptorSize()), CV_32FC1);
+    }
+
+    std::vector<float> descriptors;
+    for (int windowSize : windowSizes)
+    {
+        ArenaScope arenaScope;
+        for (int i = 0; i < rows; i++)
+        {
+            cv::Mat windowImage;
+            imresizeContain(image(result.Boxes[i]), windowImage, cv::Size(windowSize, windowSize));
+            for (int c = 0; c < hogs.size(); c++)
+            {
+                if (hogs[c].winSize.width != windowSize)
+                {
+                    continue;
+                }
+                int64_t start = cv::getTickCount();
+                hogs[c].compute(windowImage, descriptors);
+                cv::Mat(1, static_cast<int>(descriptors.size()), CV_32FC1, descriptors.data()).copyTo(result.Descriptors[c].row(i));
+                result.HogTicks[c] += cv::getTickCount() - start;
+            }
+        }
+    }
+}
+
+static int trainAndEvaluate(
+    int configIndex,
+    const std::vector<SweepImage> &sweepImages,
+    const BackgroundSampler &sampler,
+    const std::vector<ImageAnnotation> &validationAnnotations,
+    SweepResult &result)
+{
+    int64_t trainTicks = 0;
+    int64_t detectTicks = 0;
+    std::vector<cv::Mat> trainDataList;
+    std::vector<int> labels;
+    for (const SweepImage &sweepImage : sweepImages)
+    {
+        if (!sweepImage.IsTrain)
+        {
+            continue;
+        }
+        trainTicks += sweepImage.HogTicks[configIndex];
+
+        ImageSamples samples = sweepImage.Samples;
+        samples.Descriptors = sweepImage.Descriptors[configIndex];
+        ImageSamples selected;
+        sampler.selectRows(samples, selected);
+        if (selected.Descriptors.rows > 0)
+        {
+            trainDataList.push_back(selected.Descriptors);
+            labels.insert(labels.end(), selected.Labels.begin(), selected.Labels.end());
+        }
+    }
+    if (trainDataList.empty())
+    {
+        std::cout << "No training windows found" << std::endl;
+        return 1;
+    }
+
+    int64_t start = cv::getTickCount();
+    cv::Mat trainDataMatrix;
+    cv::vconcat(trainDataList, trainDataMatrix);
+    auto svm = cv::ml::SVM::create();
+    svm->setType(cv::ml::SVM::C_SVC);
+    svm->setKernel(cv::ml::SVM::LINEAR);
+    svm->trainAuto(trainDataMatrix, cv::ml::ROW_SAMPLE, labels);
+    trainTicks += cv::getTickCount() - start;
+
+    PeopleClassifier classifier;
+    if (classifier.create(svm) != 0)
+    {
+        return 1;
+    }
+
+    std::vector<ImageAnnotation> detections;
+    std::vector<float> scores;
+    for (const SweepImage &sweepImage : sweepImages)
+    {
+        if (sweepImage.IsTrain || sweepImage.Boxes.empty())
+        {
+            continue;
+        }
+        detectTicks += sweepImage.HogTicks[configIndex];
+
+        start = cv::getTickCount();
+        classifier.score(sweepImage.Descriptors[configIndex], scores);
+        detectTicks += cv::getTickCount() - start;
+        for (int i = 0; i < scores.size(); i++)
+        {
+            if (classifier.isPerson(scores[i]))
+            {
+                ImageAnnotation detection;
+                detection.FileName = sweepImage.ImageFile;
+                detection.Bbox = sweepImage.Boxes[i];
+                detection.Score = scores[i];
+                detections.push_back(detection);
+            }
+        }
+    }
+
+    result.TrainWindows = trainDataMatrix.rows;
+    result.TrainMilliseconds = trainTicks * 1000.0 / cv::getTickFrequency();
+    result.DetectMilliseconds = detectTicks * 1000.0 / cv::getTickFrequency();
+    result.Evaluation = evaluateDetections(validationAnnotations, detections, MATCH_HALF_ACTUAL_AREA);
+    return 0;
+}
+
+int sweepMain(
+    std::string annotationsFile,
+    std::string imagesDir,
+    std::string paramsFile,
+    std::string gridFile,
+    std::string outputFile,
+    int ioThreads,
+    size_t prefetchBytes,
+    std::string proposalCacheFile)
+{
+    cv::FileStorage params(paramsFile, cv::FileStorage::READ);
+    cv::HOGDescriptor baseHog;
+    createHog(params, baseHog);
+
+    std::vector<SweepConfig> configs;
+    if (readSweepGrid(gridFile, configs) != 0)
+    {
+        return 1;
+    }
+    std::vector<cv::HOGDescriptor> hogs(configs.size(), baseHog);
+    std::vector<int> windowSizes;
+    for (int c = 0; c < configs.size(); c++)
+    {
+        applySweepConfig(configs[c], hogs[c]);
+        if (std::find(windowSizes.begin(), windowSizes.end(), configs[c].WindowSize) == windowSizes.end())
+        {
+            windowSizes.push_back(configs[c].WindowSize);
+        }
+    }
+    std::cout << configs.size() << " configurations, " << windowSizes.size() << " window sizes" << std::endl;
+
+    std::vector<ImageAnnotation> annotations;
+    if (readAnnotations(annotationsFile, annotations) != 0)
+    {
+        return 1;
+    }
+    ImageSource images;
+    if (images.open(imagesDir) != 0)
+    {
+        return 1;
+    }
+
+    SampleOptions sampleOptions;
+    if (readSampleOptions(params, sampleOptions) != 0)
+    {
+        return 1;
+    }
+    std::vector<std::string> allImages = images.getImageFiles();
+    std::vector<int> annotationCounts = countAnnotationsPerImage(allImages, annotations);
+    std::vector<std::string> trainImages = getTrainOrValidationSample(allImages, annotationCounts, sampleOptions, true);
+    std::vector<std::string> validationImages = getTrainOrValidationSample(allImages, annotationCounts, sampleOptions, false);
+
+    std::unordered_map<std::string, std::vector<cv::Rect>> peopleBoxes;
+    groupPeopleBoxes(annotations, peopleBoxes);
+    const std::vector<cv::Rect> noPeople;
+    int64_t peopleCount = 0;
+    for (int i = 0; i < trainImages.size(); i++)
+    {
+        auto found = peopleBoxes.find(trainImages[i]);
+        peopleCount += found != peopleBoxes.end() ? found->second.size() : 0;
+    }
+    BackgroundSampler sampler(readBackgroundSamplingOptions(params), peopleCount);
+
+    std::unordered_set<std::string> validationSet(validationImages.begin(), validationImages.end());
+    std::vector<ImageAnnotation> validationAnnotations;
+    for (int i = 0; i < annotations.size(); i++)
+    {
+        if (validationSet.count(annotations[i].FileName) != 0)
+        {
+            validationAnnotations.push_back(annotations[i]);
+        }
+    }
+
+    // A single pass decodes every image and finds its proposals once
+    std::vector<std::string> sweepFiles = trainImages;
+    sweepFiles.insert(sweepFiles.end(), validationImages.begin(), validationImages.end());
+    ImagePrefetcher prefetcher(images, sweepFiles, ioThreads, prefetchBytes);
+    ProposalCache proposalCache;
+    if (proposalCache.open(proposalCacheFile) != 0)
+    {
+        return 1;
+    }
+    std::vector<SweepImage> sweepImages(sweepFiles.size());
+
+    cv::TickMeter extractionTimer;
+    extractionTimer.start();
+    const int chunkImages = 16 * cv::getNumThreads();
+    for (size_t chunkBegin = 0; chunkBegin < sweepFiles.size(); chunkBegin += chunkImages)
+    {
+        int chunkSize = static_cast<int>(std::min(sweepFiles.size() - chunkBegin, static_cast<size_t>(chunkImages)));
+        std::vector<PrefetchedImage> prefetched(chunkSize);
+        for (int i = 0; i < chunkSize; i++)
+        {
+            prefetcher.next(prefetched[i]);
+        }
+
+        std::vector<int> statuses(chunkSize, 0);
+        cv::parallel_for_(cv::Range(0, chunkSize), [&](const cv::Range &range)
+        {
+            for (int i = range.start; i < range.end; i++)
+            {
+                int imageIndex = static_cast<int>(chunkBegin) + i;
+                SweepImage &sweepImage = sweepImages[imageIndex];
+                sweepImage.ImageFile = prefetched[i].ImageFile;
+                sweepImage.IsTrain = imageIndex < trainImages.size();
+
+                cv::Mat image;
+                cv::Mat colorfulImage;
+                if (prefetcher.decode(prefetched[i], DECODE_GRAYSCALE, false, image, colorfulImage) != 0)
+                {
+                    statuses[i] = 1;
+                    continue;
+                }
+
+                uint64_t proposalKey = getProposalKeyOfBytes(prefetched[i].Encoded, DECODE_GRAYSCALE);
+                std::vector<cv::Rect> proposals = proposalCache.findBoxes(proposalKey, image);
+                if (sweepImage.IsTrain)
+                {
+                    auto found = peopleBoxes.find(sweepImage.ImageFile);
+                    const std::vector<cv::Rect> &imagePeople = found != peopleBoxes.end() ? found->second : noPeople;
+                    selectTrainingBoxes(proposals, imagePeople, sampler, imageIndex, sweepImage.Boxes, sweepImage.Samples);
+                }
+                else
+                {
+                    sweepImage.Boxes = proposals;
+                }
+                computeSweepDescriptors(image, hogs, windowSizes, sweepImage);
+            }
+        }, chunkSize);
+
+        for (int i = 0; i < chunkSize; i++)
+        {
+            if (statuses[i] != 0)
+            {
+                std::cout << "Cannot open image " << images.getImagePath(prefetched[i].ImageFile) << std::endl;
+                return 1;
+            }
+            sampler.add(sweepImages[chunkBegin + i].Samples.Keys);
+        }
+    }
+    extractionTimer.stop();
+    prefetcher.printStats();
+    proposalCache.printStats();
+    if (proposalCache.save() != 0)
+    {
+        return 1;
+    }
+    std::cout << "Shared decode, proposals and windows: " << extractionTimer.getTimeMilli() << " ms" << std::endl;
+
+    // Configurations train and evaluate in parallel, each one on its own SVM
+    std::vector<SweepResult> results(configs.size());
+    std::vector<int> statuses(configs.size(), 0);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(configs.size())), [&](const cv::Range &range)
+    {
+        for (int c = range.start; c < range.end; c++)
+        {
+            statuses[c] = trainAndEvaluate(c, sweepImages, sampler, validationAnnotations, results[c]);
+        }
+    });
+
+    std::ofstream csv(outputFile);
+    if (!csv.is_open())
+    {
+        std::cout << "Can't open sweep results " << outputFile << std::endl;
+        return 1;
+    }
+    csv << "windowSize,blockSize,blockStride,cellSize,nbins,descriptorSize,trainWindows,trainMs,detectMs,recall,precision" << std::endl;
+    for (int c = 0; c < configs.size(); c++)
+    {
+        if (statuses[c] != 0)
+        {
+            return 1;
+        }
+        const SweepConfig &config = configs[c];
+        const SweepResult &result = results[c];
+        csv << config.WindowSize << "," << config.BlockSize << "," << config.BlockStride << "," << config.CellSize << ","
+            << config.Nbins << "," << hogs[c].getDescriptorSize() << "," << result.TrainWindows << ","
+            << result.TrainMilliseconds << "," << result.DetectMilliseconds << ","
+            << result.Evaluation.Recall << "," << result.Evaluation.Precision << std::endl;
+    }
+    return csv.fail() ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/objdetect/objdetect.hpp>
+
+// HOG configuration of a sweep with square windows, blocks and cells.
+// Other HOG parameters come from params.yml.
+struct SweepConfig
+{
+    int WindowSize;
+    int BlockSize;
+    int BlockStride;
+    int CellSize;
+    int Nbins;
+};
+
+// Every combination of the lists in the grid file, invalid HOG geometries are skipped
+int readSweepGrid(const std::string gridFile, std::vector<SweepConfig> &configs);
+
+void applySweepConfig(const SweepConfig &config, cv::HOGDescriptor &hog);
+
+// Trains and evaluates every configuration of the grid on the train and validation
+// sample of params.yml. Images are decoded and proposals found once for all of them,
+// windows are resized once per window size. Results are written as CSV.
+int sweepMain(
+    std::string annotationsFile,
+    std::string imagesDir,
+    std::string paramsFile,
+    std::string gridFile,
+    std::string outputFile,
+    int ioThreads,
+    size_t prefetchBytes,
+    std::string proposalCacheFile);
@@ -0,0 +1,274 @@
+#include "videoDetection.h"
+#include "concurrency.h"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+struct VideoFrame
+{
+    int Sequence;
+    int FrameIndex;
+    cv::Mat Image;
+    Clock::time_point CapturedAt;
+};
+
+struct FrameDetections
+{
+    int FrameIndex;
+    std::vector<cv::Rect> Boxes;
+    Clock::time_point CapturedAt;
+};
+
+// Emits frames in decoding order no matter which worker finishes first
+class OrderedFrameWriter
+{
+public:
+    explicit OrderedFrameWriter(std::ostream &out) : out(out), nextSequence(0)
+    {
+    }
+
+    void submit(int sequence, FrameDetections detections)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending[sequence] = std::move(detections);
+
+        auto it = pending.begin();
+        while (it != pending.end() && it->first == nextSequence)
+        {
+            write(it->second);
+            it = pending.erase(it);
+            nextSequence++;
+        }
+    }
+
+    std::vector<double> getLatencies()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return latencies;
+    }
+
+private:
+    void write(const FrameDetections &detections)
+    {
+        for (int i = 0; i < detections.Boxes.size(); i++)
+        {
+            cv::Rect bbox = detections.Boxes[i];
+            out << detections.FrameIndex
+                << '\t' << bbox.y
+                << '\t' << bbox.x
+                << '\t' << bbox.y + bbox.height
+                << '\t' << bbox.x + bbox.width
+                << '\n';
+        }
+
+        std::chrono::duration<double, std::milli> latency = Clock::now() - detections.CapturedAt;
+        latencies.push_back(latency.count());
+    }
+
+    std::mutex mutex;
+    std::ostream &out;
+    std::map<int, FrameDetections> pending;
+    int nextSequence;
+    std::vector<double> latencies;
+};
+
+static double percentile(const std::vector<double> &sortedValues, double rate)
+{
+    if (sortedValues.empty())
+    {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(rate * (sortedValues.size() - 1));
+    return sortedValues[index];
+}
+
+int detectVideo(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const std::string videoPath,
+    const std::string outputFile,
+    const VideoDetectionOptions &options)
+{
+    cv::VideoCapture capture(videoPath);
+    if (!capture.isOpened())
+    {
+        std::cout << "Cannot open video " << videoPath << std::endl;
+        return 1;
+    }
+
+    std::ofstream f;
+    f.open(outputFile);
+    if (!f.is_open())
+    {
+        std::cout << "Can't open file to save annotations " << outputFile << std::endl;
+        return 1;
+    }
+
+    int workersCount = options.Workers > 0 ? options.Workers : cv::getNumberOfCPUs();
+    if (options.Incremental)
+    {
+        // Every frame builds on the state left by the previous one
+        workersCount = 1;
+    }
+    int queueSize = options.QueueSize > 0 ? options.QueueSize : 2 * workersCount;
+
+    BoundedQueue<VideoFrame> frames(queueSize);
+    OrderedFrameWriter writer(f);
+    std::atomic<int> failedFrames(0);
+    std::atomic<long long> changedTiles(0);
+    std::atomic<long long> totalTiles(0);
+    int decodedFrames = 0;
+    int skippedFrames = 0;
+    int droppedFrames = 0;
+    int submittedFrames = 0;
+
+    Clock::time_point startedAt = Clock::now();
+
+    std::thread decoder([&]()
+    {
+        Clock::duration frameInterval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(options.MaxFps > 0 ? 1.0 / options.MaxFps : 0));
+        Clock::time_point nextDue = Clock::now();
+
+        for (int frameIndex = 0;; frameIndex++)
+        {
+            if (frameIndex % (options.FrameSkip + 1) != 0)
+            {
+                // grab() avoids converting frames nobody is going to look at
+                if (!capture.grab())
+                {
+                    break;
+                }
+                skippedFrames++;
+                continue;
+            }
+
+            if (options.MaxFps > 0)
+            {
+                std::this_thread::sleep_until(nextDue);
+                nextDue = std::max(nextDue, Clock::now()) + frameInterval;
+            }
+
+            // Latency is end to end, so it starts before the frame is decoded
+            Clock::time_point capturedAt = Clock::now();
+            cv::Mat frame;
+            if (!capture.read(frame))
+            {
+                break;
+            }
+            decodedFrames++;
+
+            cv::Mat grayscale;
+            if (frame.channels() == 1)
+            {
+                grayscale = frame.clone();
+            }
+            else
+            {
+                cv::cvtColor(frame, grayscale, cv::COLOR_BGR2GRAY);
+            }
+
+            VideoFrame job;
+            job.Sequence = submittedFrames;
+            job.FrameIndex = frameIndex;
+            job.Image = grayscale;
+            job.CapturedAt = capturedAt;
+
+            bool accepted = options.DropWhenBehind
+                                ? frames.tryPush(std::move(job))
+                                : frames.push(std::move(job));
+            if (!accepted)
+            {
+                droppedFrames++;
+                continue;
+            }
+            submittedFrames++;
+        }
+
+        frames.close();
+    });
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < workersCount; w++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            IncrementalProposals proposals(options.TileSize, options.RefreshInterval, options.PixelTolerance);
+            std::vector<CachedWindow> windowsCache;
+
+            VideoFrame job;
+            while (frames.pop(job))
+            {
+                FrameDetections detections;
+                detections.FrameIndex = job.FrameIndex;
+                detections.CapturedAt = job.CapturedAt;
+
+                int status;
+                if (options.Incremental)
+                {
+                    status = detectPeopleIncremental(classifier, hog, job.Image, proposals, windowsCache, detections.Boxes);
+                    changedTiles += proposals.getChangedTilesCount();
+                    totalTiles += proposals.getTilesCount();
+                }
+                else
+                {
+                    status = detectPeople(classifier, hog, job.Image, detections.Boxes);
+                }
+
+                if (status != 0)
+                {
+                    failedFrames++;
+                    detections.Boxes.clear();
+                }
+                writer.submit(job.Sequence, std::move(detections));
+            }
+        }));
+    }
+
+    decoder.join();
+    for (int w = 0; w < workers.size(); w++)
+    {
+        workers[w].join();
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - startedAt;
+    f.close();
+
+    std::vector<double> latencies = writer.getLatencies();
+    std::sort(latencies.begin(), latencies.end());
+    double latencySum = 0;
+    for (int i = 0; i < latencies.size(); i++)
+    {
+        latencySum += latencies[i];
+    }
+
+    std::cout << "Frames decoded : " << decodedFrames << std::endl;
+    std::cout << "Frames skipped : " << skippedFrames << std::endl;
+    std::cout << "Frames dropped : " << droppedFrames << std::endl;
+    std::cout << "Frames detected: " << latencies.size() << std::endl;
+    std::cout << "Sustained fps  : " << (elapsed.count() > 0 ? latencies.size() / elapsed.count() : 0) << std::endl;
+    std::cout << "Latency ms avg : " << (latencies.empty() ? 0 : latencySum / latencies.size()) << std::endl;
+    std::cout << "Latency ms p50 : " << percentile(latencies, 0.5) << std::endl;
+    std::cout << "Latency ms p95 : " << percentile(latencies, 0.95) << std::endl;
+    std::cout << "Latency ms max : " << percentile(latencies, 1.0) << std::endl;
+    if (options.Incremental && totalTiles > 0)
+    {
+        std::cout << "Changed tiles  : " << 100.0 * changedTiles / totalTiles << "%" << std::endl;
+    }
+
+    if (failedFrames > 0)
+    {
+        std::cout << "Error during detection on " << failedFrames << " frames" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
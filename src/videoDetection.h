@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include "detection.h"
+
+struct VideoDetectionOptions
+{
+    int FrameSkip = 0;           // Frames skipped after every detected frame
+    double MaxFps = 0;           // Limit of frames submitted for detection per second, 0 is unlimited
+    int Workers = 0;             // Detection threads, 0 uses every CPU
+    int QueueSize = 0;           // Frames waiting for detection, 0 is twice the workers count
+    bool DropWhenBehind = false; // Drop new frames instead of waiting for a free queue slot
+
+    bool Incremental = false;    // Reuse proposals and windows of unchanged tiles, needs a single worker
+    int TileSize = 32;           // Side of the tiles compared between frames
+    int RefreshInterval = 30;    // Frames between two full recomputations
+    int PixelTolerance = 8;      // Largest pixel difference that is not a change
+};
+
+// Decodes the video on its own thread and detects people on a pool of workers.
+// Boxes are written in the annotations format with the frame index as the image name.
+int detectVideo(
+    const PeopleClassifier &classifier,
+    const cv::HOGDescriptor &hog,
+    const std::string videoPath,
+    const std::string outputFile,
+    const VideoDetectionOptions &options);
@@ -0,0 +1,170 @@
+#include "visualization.h"
+#include "ioUtils.h"
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <iostream>
+
+DetectionRenderer::DetectionRenderer(bool showWindow, const std::string outputDir, int encodersCount, int queueSize)
+    : showWindow(showWindow),
+      outputDir(outputDir),
+      renderQueue(queueSize),
+      encodeQueue(queueSize),
+      displayQueue(1),
+      isShowing(showWindow),
+      droppedCount(0),
+      isFinished(false)
+{
+    if (!isActive())
+    {
+        isFinished = true;
+        return;
+    }
+
+    if (!outputDir.empty())
+    {
+        cv::utils::fs::createDirectories(outputDir);
+        for (int i = 0; i < encodersCount; i++)
+        {
+            encoders.push_back(std::thread(&DetectionRenderer::encodeLoop, this));
+        }
+    }
+    if (showWindow)
+    {
+        display = std::thread(&DetectionRenderer::displayLoop, this);
+    }
+    renderer = std::thread(&DetectionRenderer::renderLoop, this);
+}
+
+DetectionRenderer::~DetectionRenderer()
+{
+    finish();
+}
+
+bool DetectionRenderer::isActive() const
+{
+    return showWindow || !outputDir.empty();
+}
+
+void DetectionRenderer::submit(const std::string imageFile, const cv::Mat image, const std::vector<cv::Rect> &boxes)
+{
+    if (isFinished)
+    {
+        return;
+    }
+
+    RenderJob job;
+    job.ImageFile = imageFile;
+    job.Image = image;
+    job.Boxes = boxes;
+    if (!renderQueue.tryPush(std::move(job)))
+    {
+        droppedCount++;
+    }
+}
+
+void DetectionRenderer::finish()
+{
+    if (isFinished)
+    {
+        return;
+    }
+    isFinished = true;
+
+    renderQueue.close();
+    renderer.join();
+
+    displayQueue.close();
+    if (display.joinable())
+    {
+        display.join();
+    }
+
+    encodeQueue.close();
+    for (int i = 0; i < encoders.size(); i++)
+    {
+        encoders[i].join();
+    }
+}
+
+int DetectionRenderer::getDroppedCount() const
+{
+    return droppedCount;
+}
+
+void DetectionRenderer::renderLoop()
+{
+    RenderJob job;
+    while (renderQueue.pop(job))
+    {
+        // Grayscale decodes are turned into color here rather than on the detection thread
+        cv::Mat colorfulImage;
+        if (job.Image.channels() == 1)
+        {
+            cv::cvtColor(job.Image, colorfulImage, cv::COLOR_GRAY2BGR);
+        }
+        else
+        {
+            colorfulImage = job.Image;
+        }
+
+        for (int i = 0; i < job.Boxes.size(); i++)
+        {
+            cv::rectangle(colorfulImage, job.Boxes[i], cv::Scalar(0, 0, 255));
+        }
+        job.Image = colorfulImage;
+
+        if (!outputDir.empty() && !encodeQueue.tryPush(std::move(job)))
+        {
+            droppedCount++;
+        }
+
+        // Images arriving while the window waits are only skipped on screen
+        if (isShowing && !displayQueue.tryPush(colorfulImage) && outputDir.empty())
+        {
+            droppedCount++;
+        }
+    }
+}
+
+void DetectionRenderer::displayLoop()
+{
+    cv::Mat image;
+    while (displayQueue.pop(image))
+    {
+        if (!isShowing)
+        {
+            continue;
+        }
+
+        // Hosts without a display throw here, the images are still written
+        try
+        {
+            cv::imshow("Detection", image);
+            if (cv::waitKey(5000) == -1)
+            {
+                isShowing = false;
+                cv::destroyWindow("Detection");
+            }
+        }
+        catch (const cv::Exception &e)
+        {
+            std::cout << "Can't show detections: " << e.what() << std::endl;
+            isShowing = false;
+        }
+    }
+}
+
+void DetectionRenderer::encodeLoop()
+{
+    RenderJob job;
+    while (encodeQueue.pop(job))
+    {
+        std::string imagePath = combinePath(outputDir, job.ImageFile);
+        if (!cv::imwrite(imagePath, job.Image))
+        {
+            std::cout << "Can't save annotated image " << imagePath << std::endl;
+        }
+    }
+}
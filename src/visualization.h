@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "concurrency.h"
+
+struct RenderJob
+{
+    std::string ImageFile;
+    cv::Mat Image;
+    std::vector<cv::Rect> Boxes;
+};
+
+// Draws detections away from the detection loop. Results are shown in a window
+// and/or written as annotated JPEGs by a pool of encoder threads.
+class DetectionRenderer
+{
+public:
+    // outputDir may be empty to skip writing images
+    DetectionRenderer(bool showWindow, const std::string outputDir, int encodersCount, int queueSize);
+    ~DetectionRenderer();
+
+    bool isActive() const;
+
+    // Never waits: the image is dropped when the renderer falls behind
+    void submit(const std::string imageFile, const cv::Mat image, const std::vector<cv::Rect> &boxes);
+
+    // Waits for everything that was accepted to be shown and written
+    void finish();
+
+    int getDroppedCount() const;
+
+private:
+    void renderLoop();
+    void displayLoop();
+    void encodeLoop();
+
+    bool showWindow;
+    std::string outputDir;
+    BoundedQueue<RenderJob> renderQueue;
+    BoundedQueue<RenderJob> encodeQueue;
+    // Waiting for a key in the window never holds up drawing or encoding
+    BoundedQueue<cv::Mat> displayQueue;
+    std::atomic<bool> isShowing;
+    std::thread renderer;
+    std::thread display;
+    std::vector<std::thread> encoders;
+    std::atomic<int> droppedCount;
+    bool isFinished;
+};
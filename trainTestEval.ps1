@@ -1,8 +1,8 @@
 cd ./bin
 try {
     ./main.exe train
-    ./main.exe test
-    ./main.exe eval
+    ./main.exe test -o=../results.bin
+    ./main.exe eval -o=../results.bin
 } finally {
     cd ..
-}
\ No newline at end of file
+}